@@ -8,10 +8,10 @@ if ! [ -x "$(command -v gcc)" ]; then
     echo "+ falling back to clang compiler..."
     echo "+ using clang to compile the source code..."
     
-    clang -Ofast -o sqlyte src/*.c
+    clang -Ofast -pthread -o sqlyte src/*.c
     
     exit 1
 fi
 
 echo "+ using gcc to compile the source code..."
-gcc -Ofast -o sqlyte src/*.c
\ No newline at end of file
+gcc -Ofast -pthread -o sqlyte src/*.c
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*
+    MIT License
+
+    Copyright (c) 2024 winterrdog
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef _SQLYTE_CRC32C_H
+#define _SQLYTE_CRC32C_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+** CRC32C( Castagnoli ), the checksum every page carries in its trailer.
+**
+** x86-64 CPUs with SSE4.2 have an instruction for it that eats 8 bytes at a
+** time, so a whole page costs a few hundred nanoseconds. Everywhere else we
+** fall back to a table, one byte at a time. The pick is made once, by
+** crc32c_init(), which has to run before the first crc32c().
+*/
+#define CRC32C_POLY 0x82f63b78 // reversed
+
+static uint32_t crc32c_table[256];
+static uint32_t (*crc32c_impl)(uint32_t crc, const void* buf, size_t len);
+
+static uint32_t crc32c_sw(uint32_t crc, const void* buf, size_t len)
+{
+    const unsigned char* p = buf;
+
+    while (len--) {
+        crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_CRC32C_HW 1
+
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(
+    uint32_t crc, const void* buf, size_t len)
+{
+    const unsigned char* p = buf;
+    uint64_t crc64 = crc, word;
+
+    for (; len >= sizeof(word); len -= sizeof(word), p += sizeof(word)) {
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t)crc64;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return crc;
+}
+#endif
+
+static void crc32c_init(void)
+{
+    uint32_t i, j, crc;
+
+    for (i = 0; i != 256; ++i) {
+        for (crc = i, j = 0; j != 8; ++j) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[i] = crc;
+    }
+
+    crc32c_impl = crc32c_sw;
+#ifdef HAVE_CRC32C_HW
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_hw;
+    }
+#endif
+}
+
+static uint32_t crc32c(const void* buf, size_t len)
+{
+    return ~crc32c_impl(~(uint32_t)0, buf, len);
+}
+
+#endif
@@ -21,16 +21,27 @@
     FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
     IN THE SOFTWARE.
 */
+#define _GNU_SOURCE // for O_DIRECT
+
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 //
+#include "crc32c.h"
+#include "lz.h"
+#include "uring.h"
 #include "xmem.h"
 
 #define PRINT_TO_STDERR(fmt, ...) fprintf(stderr, fmt, __VA_ARGS__)
@@ -41,27 +52,352 @@
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
 
-// table-related
-#define TABLE_MAX_PAGES 100
+// page sizes a db file can be created with, any power of 2 in between works
+#define DEFAULT_PAGE_SIZE 4096
+#define MIN_PAGE_SIZE 4096
+#define MAX_PAGE_SIZE 65536
+
+// buffer pool sizing( in frames, each frame holds one page ). a b-tree
+// operation pins the pages it holds on to, the pool has to have room for all
+// of them plus the ones it reads in on the way
+#define DEFAULT_POOL_FRAMES 1024
+#define MIN_POOL_FRAMES 64
+
+// the fewest keys "--max-keys" lets an internal node have, a split has to
+// leave both halves with at least 2 children
+#define MIN_INTERNAL_NODE_KEYS 2
+
+// pages the db file grows by at a time. they're allocated on disk in one go
+// so a big load ends up in a few contiguous extents
+#define DEFAULT_EXTENT_PAGES 256
+
+// how full ".load" packs the leaves( in % ) unless it's told otherwise
+#define DEFAULT_LOAD_FILL 100
 
 // marks a key as not having sibling
 #define NO_SIBLING 0x0
 
-#define INVALID_PAGE_NUM UINT32_MAX
+#define DB_HEADER_MAGIC 0x4554594c // "LYTE"
+#define DB_HEADER_VERSION 4
+#define HEADER_PAGE_NUM 0x0
+
+// db header flags
+#define DB_FLAG_COMPRESSED 0x1 // pages may be stored compressed
+
+// compressed pages are stored in whole blocks at the start of their page's
+// slot, anything smaller than a filesystem block saves nothing
+#define SLOT_BLOCK_SIZE 4096
+#define SLOT_MAGIC 0x5a4c5953 // "SYLZ", never the start of a node
+
+#define INVALID_PAGE_NUM UINT64_MAX
+
+// most pages written by one vectored write( IOV_MAX on linux )
+#define MAX_RUN_PAGES 1024
+
+// address space reserved for the mapping in mmap mode, i.e. the biggest db
+// file it can handle, and how many pages the mapping grows by at a time
+#define MMAP_RESERVE_SIZE ((size_t)1 << 40)
+#define MMAP_GROW_PAGES 256
+
+// io_uring submission queue size
+#define URING_ENTRIES 64
+
+// readahead for scans: leaf steps in a row before it kicks in, the first and
+// the biggest window of leaves it reads ahead and the deepest tree it can walk
+#define READAHEAD_MIN_RUN 2
+#define READAHEAD_MIN_WINDOW 8
+#define READAHEAD_MAX_WINDOW 256
+#define READAHEAD_MAX_DEPTH 32
 
+// write-ahead log tuning: how many frames the log collects before it's
+// checkpointed into the db file in the background and how big it may grow
+// before a commit waits for the checkpoint instead
+#define WAL_CHECKPOINT_FRAMES 1024
+#define WAL_MAX_FRAMES (4 * WAL_CHECKPOINT_FRAMES)
+
+// frames appended by one vectored write( two iovecs per frame ) and pages
+// copied into the db file by one write during a checkpoint
+#define WAL_BATCH_FRAMES (MAX_RUN_PAGES / 2)
+#define WAL_BACKFILL_RUN 64
+
+// pages an online backup copies between two statements
+#define BACKUP_STEP_PAGES 64
+
+#define WARM_MAGIC 0x4d524157 // "WARM"
+#define WAL_MAGIC 0x4c415753 // "SWAL"
+#define WAL_VERSION 2
+#define WAL_NO_FRAME UINT32_MAX
+
+// marks the end of a page table chain
+#define NO_FRAME UINT32_MAX
+
+// page table bucket a page hashes to
+#define PAGE_TABLE_BUCKET(pager, page_num) ((page_num) & ((pager)->num_buckets - 1))
+
+typedef unsigned long long u64;
 typedef unsigned int u32;
 typedef unsigned char u8;
 
 /*
-    used by database to interact with filesystem and memory
+    a slot in the buffer pool that holds one page in memory
+*/
+typedef struct {
+    u64 page_num; // page held by the frame, INVALID_PAGE_NUM if the frame is free
+    u32 hash_next; // next frame in the same page table bucket
+    u32 pin_count; // a pinned frame is never recycled
+    bool referenced; // "second chance" bit used by the CLOCK replacement policy
+    bool dirty; // must be written back to disk before the frame is reused
+    bool unverified; // read in, but its checksum wasn't checked yet
+    void* data;
+} frame_t;
+
+/*
+    how the pager gets pages into memory
+*/
+typedef enum {
+    PAGER_MODE_BUFFERED = 0, // pages are read into the buffer pool
+    PAGER_MODE_MMAP // pages are used in place from a memory-mapped db file
+} pager_mode_t;
+
+/*
+    how hard the pager works to get commits onto stable storage
+*/
+typedef enum {
+    SYNC_MODE_OFF = 0, // never fsync, leave it all to the kernel
+    SYNC_MODE_NORMAL, // fsync only when checkpointing, a crash can lose the last commits
+    SYNC_MODE_FULL // a commit is on disk before its statement is acknowledged
+} sync_mode_t;
+
+/*
+    when a page read in from disk gets its checksum checked
+*/
+typedef enum {
+    VERIFY_MODE_READ = 0, // as soon as it's read, read-ahead included
+    VERIFY_MODE_LAZY, // the first time get_page() hands it out
+    VERIFY_MODE_CHECK // only by ".check"
+} verify_mode_t;
+
+/*
+    page 0 of every db file. the b-tree starts at page 1
+*/
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 page_size;
+    u32 tree_height; // 1 while the root is a leaf
+    u64 root_page;
+    u64 num_pages; // pages in use, the file itself may be longer
+    u64 freelist_trunk; // first freelist trunk page, 0 when nothing is free
+    u64 freelist_count; // free pages, trunks included
+    u64 num_rows;
+    u32 flags; // DB_FLAG_*
+    u32 internal_max_keys; // cap on internal node keys, 0 for as many as fit
+} db_header_t;
+
+/*
+    start of a compressed page's slot in the db file. the rest of the slot
+    past the compressed bytes is a hole
+*/
+typedef struct {
+    u32 magic;
+    u32 len; // compressed bytes that follow
+} slot_header_t;
+
+/*
+    first bytes of the write-ahead log file
+*/
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 page_size;
+    u32 salt; // changes every time the log restarts, stale frames won't match
+} wal_header_t;
+
+/*
+    every page image in the log is preceded by one of these
+*/
+typedef struct {
+    u64 page_num;
+    u64 db_size; // pages in the db after this commit, 0 if not a commit frame
+    u32 salt;
+    u32 checksum; // over the fields above and the page image
+} wal_frame_header_t;
+
+// a page and the log frame holding its latest image
+typedef struct {
+    u64 page_num;
+    u32 frame_num;
+} wal_entry_t;
+
+/*
+    write-ahead log. changed pages are appended to "<db file>-wal" at the end
+    of every statement and fsynced as the sync mode asks for. a background
+    thread copies the logged pages into the db file( checkpoint )
+    and once it has caught up the log starts over from the top.
 */
 typedef struct {
     int fd;
-    u32 file_len;
+    char* path;
+    u32 salt;
+    u32 num_frames; // frames in the log, including uncommitted ones
+    u32 committed_frames; // frames up to and including the last commit frame
+    u32 synced_frames; // frames on stable storage( as far as the sync mode cares )
+    sync_mode_t sync_mode; // the pager's, the checkpointer reads it under "lock"
+
+    // wal index: open addressing hash of page number -> latest frame
+    wal_entry_t* index;
+    u32 index_capacity; // always a power of 2
+    u32 index_count;
+
+    // frames waiting to be appended with the next vectored write
+    wal_frame_header_t* batch_headers;
+    struct iovec* batch_iov;
+    u32 batch_len;
+
+    // background checkpointer. everything below is guarded by "lock"
+    pthread_t checkpointer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool checkpoint_requested;
+    bool stop;
+    u32 checkpoint_upto; // frames the running checkpoint copies
+    u32 backfilled; // frames already copied into the db file
+    off_t backfill_end; // furthest byte of the db file a checkpoint wrote
+    wal_entry_t* snapshot; // pages the running checkpoint copies
+    u32 snapshot_len;
+    u32 snapshot_capacity;
+    void* backfill_buf; // one run of pages on its way to the db file
+    void* slot_buf; // compresses backfilled pages, NULL unless the pager does
+    int db_fd;
+} wal_t;
+
+/*
+    "<db file>-warm" starts with this, followed by "num_pages" page numbers
+    that were in the buffer pool when the db was last closed, hottest first
+*/
+typedef struct {
+    u32 magic;
+    u32 page_size;
     u32 num_pages;
-    void* pages[TABLE_MAX_PAGES];
+    u32 checksum; // of the page numbers
+} warm_header_t;
+
+/*
+    keeps track of a scan walking the leaf chain, see cursor_readahead()
+*/
+typedef struct {
+    u64 last_page_num; // leaf the last step landed on
+    u32 run; // steps in a row that followed the leaf chain
+    u32 steps_left; // until the next window is due, the middle of the last one
+    u32 window; // leaves to read ahead next time
+    u64 num_pages; // read ahead so far, for .stats
+} readahead_t;
+
+/*
+    an online backup, copied a few pages at a time in between statements.
+    pages that change after they were copied are flagged and copied again,
+    the header goes last, so once nothing's left to copy the file holds the
+    db as it was after the last statement
+*/
+typedef struct {
+    int fd;
+    char* path; // where the copy ends up once it's complete
+    char* tmp_path; // "<path>-tmp", where it's written until then
+    u64 next_page; // every page below it was copied at least once
+    u8* changed; // bitmap of copied pages that changed since
+    size_t changed_len; // in bytes
+    u64 num_changed;
+    u64 first_changed; // no flagged page comes before it
+    u64 pages_copied; // recopies included
+    void* buf;
+} backup_t;
+
+/*
+    used by database to interact with filesystem and memory.
+
+    pages are cached in a fixed number of frames, so memory use stays bounded
+    no matter how big the db file gets. the page table maps a page number to
+    the frame holding it and frames are recycled using the CLOCK policy.
+*/
+typedef struct {
+    int fd;
+    pager_mode_t mode;
+    off_t file_len; // bytes of the db file that hold pages
+    off_t alloc_len; // size of the db file, preallocated tail included
+    u32 extent_pages; // 0 when the file isn't preallocated
+    u64 num_pages;
+    u32 num_frames;
+    u32 clock_hand;
+    u32 num_dirty; // pages changed since they were read in( or last logged )
+    u32 num_pinned; // pins held, summed over all frames
+    u32 num_buckets; // always a power of 2
+    u32* buckets; // page table, heads of the frame chains
+    frame_t* frames;
+    frame_t** flush_list; // scratch space for sorting dirty frames
+    struct iovec* flush_iov; // scratch space for the runs being written back
+    void* arena; // backing memory for all frames
+
+    // db file was opened with O_DIRECT, the buffer pool is the only cache
+    bool direct;
+    sync_mode_t sync_mode;
+    verify_mode_t verify_mode;
+
+    // pages written to the db file are compressed. "slot_buf" is there
+    // either way, reading a compressed page needs it too
+    bool compress;
+    void* slot_buf;
+
+    // keys an internal node may hold, the db's own cap or INTERNAL_NODE_MAX_KEYS.
+    // until the header is read it's whatever --max-keys asked for
+    u32 internal_max_keys;
+
+    // io_uring backend, NULL when reads and writes are done synchronously
+    uring_t* ring;
+    struct iovec ring_iov[URING_ENTRIES]; // one per read in flight
+
+    readahead_t ra;
+
+    // in-memory copy of the header page, copied back into page 0 whenever
+    // it changed and the pager commits or checkpoints
+    db_header_t header;
+    bool header_dirty;
+
+    // write-ahead log, NULL when changes are written straight to the db file
+    wal_t* wal;
+
+    // "<db file>-warm", NULL when the pool isn't saved and preloaded
+    char* warm_path;
+
+    // online backup in progress, NULL when there's none
+    backup_t* backup;
+
+    // mmap mode only
+    void* map; // start of the reserved address space, db file is mapped here
+    size_t map_len; // bytes of the db file currently mapped
+    size_t map_reserved;
+    u8* dirty_map; // bitmap of changed pages, there are no frames to flag
+    u8* verified_map; // bitmap of pages whose checksum was checked
+    size_t dirty_map_len; // in bytes, same for both bitmaps
 } pager_t;
 
+/*
+    knobs that can be tweaked when opening a database
+*/
+typedef struct {
+    u32 pool_frames;
+    pager_mode_t mode;
+    bool io_uring;
+    bool direct;
+    bool wal;
+    bool warm_start;
+    bool compress;
+    sync_mode_t sync_mode;
+    verify_mode_t verify_mode;
+    u32 extent_pages;
+    u32 page_size; // only used when creating a db file
+    u32 internal_max_keys; // 0 fills internal nodes up, tests lower it to cover splits( debug only )
+} db_options_t;
+
 /*
     hard-coded schema type/shape
 */
@@ -111,32 +447,48 @@ typedef enum {
 typedef enum {
     EXECUTE_SUCCESS = 0,
     EXECUTE_TABLE_FULL,
-    EXECUTE_DUPLICATE_KEY
+    EXECUTE_DUPLICATE_KEY,
+    EXECUTE_KEY_NOT_FOUND
 } execute_result_t;
 
 // type for all actual SQL statements used in our SQL database
 // e.g. SELECT or INSERT
-typedef enum { STATEMENT_INSERT = 0, STATEMENT_SELECT } statement_t;
+typedef enum {
+    STATEMENT_INSERT = 0,
+    STATEMENT_SELECT,
+    STATEMENT_SELECT_COUNT,
+    STATEMENT_DELETE,
+    STATEMENT_UPDATE
+} statement_t;
 typedef struct {
     statement_t type;
-    row_t row_to_insert; // only used by "INSERT"
+    row_t row_to_insert; // used by "INSERT" and "UPDATE"
+    bool or_replace; // "INSERT OR REPLACE", overwrite the row if the id's taken
+    u32 first_id, last_id; // only used by "DELETE", both ends included
 } statement;
 
-// table data structure layout
-const u32 PAGE_SIZE = 4096;
-const u32 ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;
-const u32 TABLE_MAX_ROWS = ROWS_PER_PAGE * TABLE_MAX_PAGES;
+// table data structure layout. the page size is picked when a db file is
+// created and kept in its header, set_page_size() works out everything that
+// depends on it
+u32 PAGE_SIZE = DEFAULT_PAGE_SIZE;
 typedef struct {
-    u32 root_page_num;
+    u64 root_page_num;
     pager_t* pager;
+
+    // what the db was opened with, ".vacuum" reopens it after the swap
+    const char* fname;
+    db_options_t* opts;
 } table_t;
 typedef struct {
     table_t* table;
-    u32 page_num;
+    u64 page_num;
     u32 cell_num;
     bool end_of_table; // indicates a position one past the last element
 } cursor_t;
 
+// every page ends with a crc32c of the rest of it
+const u32 PAGE_TRAILER_SIZE = sizeof(u32);
+
 // B -T R E E
 // S P E C I F I C S //
 
@@ -145,7 +497,7 @@ typedef enum { NODE_INTERNAL, NODE_LEAF } node_type_t;
 // node header layout
 const u32 NODE_TYPE_SIZE = sizeof(u8);
 const u32 IS_ROOT_SIZE = sizeof(u8);
-const u32 PARENT_POINTER_SIZE = sizeof(u32);
+const u32 PARENT_POINTER_SIZE = sizeof(u64);
 const u8 COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
 
 // offsets
@@ -156,7 +508,7 @@ const u32 PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
 // leaf node header layout
 const u32 LEAF_NODE_NUM_CELLS_SIZE = sizeof(u32);
 const u32 LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
-const u32 LEAF_NODE_NEXT_LEAF_SIZE = sizeof(u32);
+const u32 LEAF_NODE_NEXT_LEAF_SIZE = sizeof(u64);
 const u32 LEAF_NODE_NEXT_LEAF_OFFSET
     = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
 const u32 LEAF_NODE_HEADER_SIZE
@@ -168,72 +520,222 @@ const u32 LEAF_NODE_KEY_OFFSET = 0x0;
 const u32 LEAF_NODE_VALUE_SIZE = ROW_SIZE;
 const u32 LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
 const u32 LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-const u32 LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-const u32 LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+u32 LEAF_NODE_SPACE_FOR_CELLS; // PAGE_SIZE - LEAF_NODE_HEADER_SIZE - PAGE_TRAILER_SIZE
+u32 LEAF_NODE_MAX_CELLS; // LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE
 
 // leaf node sizes
-const u32 LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-const u32 LEAF_NODE_LEFT_SPLIT_COUNT
-    = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+u32 LEAF_NODE_RIGHT_SPLIT_COUNT; // (LEAF_NODE_MAX_CELLS + 1) / 2
+u32 LEAF_NODE_LEFT_SPLIT_COUNT; // (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT
+u32 LEAF_NODE_MIN_CELLS; // LEAF_NODE_MAX_CELLS / 2, fewer than that after a delete and it's rebalanced
 
 // internal node header layout
 const u32 INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(u32);
 const u32 INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
-const u32 INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(u32);
+const u32 INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(u64);
 const u32 INTERNAL_NODE_RIGHT_CHILD_OFFSET
     = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
+const u32 INTERNAL_NODE_MAX_KEY_SIZE = sizeof(u32); // biggest key in the subtree
+const u32 INTERNAL_NODE_MAX_KEY_OFFSET
+    = INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
 const u32 INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE
-    + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+    + INTERNAL_NODE_RIGHT_CHILD_SIZE + INTERNAL_NODE_MAX_KEY_SIZE;
 
 // internal node body layout
 const u32 INTERNAL_NODE_KEY_SIZE = sizeof(u32);
-const u32 INTERNAL_NODE_CHILD_SIZE = sizeof(u32);
+const u32 INTERNAL_NODE_CHILD_SIZE = sizeof(u64);
 const u32 INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
-const u32 INTERNAL_NODE_MAX_KEYS = 3; // keep it small for now
+u32 INTERNAL_NODE_MAX_KEYS; // (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE - PAGE_TRAILER_SIZE) / INTERNAL_NODE_CELL_SIZE
+
+/*
+    an internal node's children while it's being split, with the child that
+    caused the split already in place. see internal_split_child()
+*/
+typedef struct {
+    void* node;
+    u32 num_keys; // the node's, before the split
+    u64 right_child;
+    u32 right_max; // the biggest key under "right_child"
+    u32 insert_at; // where the new child goes, counting the right child
+    u64 new_child;
+    u32 new_max;
+} internal_split_t;
 
 // E N D
 // O F
 // B - T R E E
 
+/*
+    freed pages are chained thru "trunk" pages. each trunk points to the next
+    one and lists as many free "leaf" pages as fit in it
+*/
+const u32 FREELIST_NEXT_TRUNK_SIZE = sizeof(u64);
+const u32 FREELIST_NEXT_TRUNK_OFFSET = 0x0;
+const u32 FREELIST_NUM_LEAVES_SIZE = sizeof(u32);
+const u32 FREELIST_NUM_LEAVES_OFFSET = FREELIST_NEXT_TRUNK_OFFSET + FREELIST_NEXT_TRUNK_SIZE;
+const u32 FREELIST_LEAVES_OFFSET = FREELIST_NUM_LEAVES_OFFSET + FREELIST_NUM_LEAVES_SIZE;
+u32 FREELIST_TRUNK_MAX_LEAVES; // (PAGE_SIZE - FREELIST_LEAVES_OFFSET - PAGE_TRAILER_SIZE) / sizeof(u64)
+
+/*
+    builds a b-tree bottom-up from rows handed over in key order. the number
+    of rows is known up front, so the shape of the whole tree is worked out
+    before the first row comes in: every level spreads its items evenly over
+    as few nodes as it can and each node lands on a page that's known ahead
+    of time. each page then gets filled in exactly once.
+
+    the root is on page 1, the internal levels follow it top-down and the
+    leaves come last, one after the other in key order
+*/
+#define TREE_BUILDER_MAX_LEVELS 32
+typedef struct {
+    u64 first_page; // nodes of a level sit on consecutive pages
+    u64 num_nodes;
+    u64 num_items; // rows for the leaves, children for internal nodes
+    u64 items_added;
+} tree_level_t;
+typedef struct {
+    pager_t* pager;
+    u32 num_levels; // leaves are level 0, the root is the last level
+    u32 last_key; // keys have to keep going up
+    tree_level_t levels[TREE_BUILDER_MAX_LEVELS];
+} tree_builder_t;
+
 // function prototypes
 void close_input_buffer(input_buffer_t* in);
 void print_row(row_t* r);
-void* get_page(pager_t* pager, u32 page_num);
+void* get_page(pager_t* pager, u64 page_num);
 void serialize_row(row_t* src, void* dest);
 void deserialize_row(void* src, row_t* dest);
 void print_prompt(void);
 void print_help(void);
 int read_input(input_buffer_t* in);
-void run_repl(const char* fname);
+void run_repl(const char* fname, db_options_t* opts);
 void cursor_advance(cursor_t* c);
+void cursor_readahead(cursor_t* c, void* leaf, u64 next_page_num);
+u32 collect_next_leaves(table_t* t, u32 key, u64* page_nums, u32 max_count);
 void* cursor_value(cursor_t* c);
-void pager_flush(pager_t* pager, u32 page_num);
+void pager_flush(pager_t* pager, u64 page_num);
+void pager_mark_dirty(pager_t* pager, u64 page_num);
+void* pager_pin(pager_t* pager, u64 page_num);
+void pager_unpin(pager_t* pager, u64 page_num);
+void pager_checkpoint(pager_t* pager);
+void pager_submit_writes(pager_t* pager);
+void pager_install_frame(pager_t* pager, frame_t* frame, u64 page_num);
+void pager_prefetch(pager_t* pager, u64* page_nums, u32 count);
+void pager_readahead(pager_t* pager, u64* page_nums, u32 count);
+void pager_advise(pager_t* pager, u64 first_page_num, u32 num_pages);
+int pager_set_direct(pager_t* pager);
+void pager_reserve(pager_t* pager, u64 num_pages);
+void pager_trim(pager_t* pager);
+void pager_read_done(void* ctx, uint64_t frame_idx, int res);
+void pager_write_done(void* ctx, uint64_t run, int res);
+void pager_write_run(pager_t* pager, u64 first_page_num, struct iovec* iov, u32 run_len);
+int db_write_pages(int fd, u64 first_page_num, struct iovec* iov, u32 run_len, void* slot_buf);
+int db_write_run(int fd, u64 first_page_num, struct iovec* iov, u32 run_len);
+u32 page_compress(void* page, void* slot);
+bool page_inflate(void* page, void* scratch);
+void pager_inflate(pager_t* pager, u64 page_num, void* page);
+int compare_frame_page_nums(const void* a, const void* b);
+frame_t* pager_find_frame(pager_t* pager, u64 page_num);
+frame_t* pager_get_victim(pager_t* pager);
+void pager_close(pager_t* pager);
+int pager_commit(pager_t* pager);
+void pager_init_header(pager_t* pager);
+void pager_read_header(pager_t* pager);
+void pager_write_header(pager_t* pager);
+void pager_flush_header(pager_t* pager);
+bool page_is_zeroed(void* page);
+void print_header(pager_t* pager);
+void set_page_size(u32 page_size);
+bool is_valid_page_size(u32 page_size);
+execute_result_t exec_select_count(statement* st, table_t* t);
+void pager_free_page(pager_t* pager, u64 page_num);
+u64* freelist_next_trunk(void* trunk);
+u32* freelist_num_leaves(void* trunk);
+u64* freelist_leaf(void* trunk, u32 leaf_num);
+int pager_sync(pager_t* pager);
+int pager_set_sync_mode(pager_t* pager, sync_mode_t mode);
+int parse_sync_mode(const char* name, sync_mode_t* mode);
+meta_cmd_result_t exec_sync_cmd(const char* arg, pager_t* pager);
+const char* sync_mode_name(sync_mode_t mode);
+void page_set_checksum(void* page);
+bool page_checksum_ok(void* page);
+void pager_verify_frame(frame_t* frame);
+void verify_page(u64 page_num, void* page);
+u64 pager_check(pager_t* pager);
+int parse_verify_mode(const char* name, verify_mode_t* mode);
+int wal_sync(wal_t* wal);
+int wal_open(pager_t* pager, const char* db_fname);
+void wal_recover(wal_t* wal);
+void wal_restart(wal_t* wal, u32 salt);
+u32 wal_checksum(const void* data, size_t len, u32 seed);
+off_t wal_frame_offset(u32 frame_num);
+u32 wal_index_lookup(wal_t* wal, u64 page_num);
+void wal_index_set(wal_t* wal, u64 page_num, u32 frame_num);
+void wal_read_page(wal_t* wal, u32 frame_num, void* dest);
+void wal_queue_frame(wal_t* wal, u64 page_num, void* data);
+void wal_write_batch(wal_t* wal, u64 db_size);
+void wal_start_checkpoint(wal_t* wal);
+void wal_wait_checkpoint(wal_t* wal);
+void wal_checkpoint(pager_t* pager);
+void wal_try_restart(pager_t* pager);
+void* wal_checkpointer(void* arg);
+off_t wal_backfill(wal_t* wal, bool sync);
+int compare_wal_entries(const void* a, const void* b);
+void wal_close(pager_t* pager);
+bool input_pending(void);
+void pager_save_warm_set(pager_t* pager);
+void pager_warm_start(pager_t* pager);
+void pager_preload(pager_t* pager, u64* page_nums, u32 count);
+void pager_read_run(pager_t* pager, u64 first_page_num, struct iovec* iov, u32 run_len);
+int compare_page_nums(const void* a, const void* b);
 void db_close(table_t* t);
 cursor_t* table_start(table_t* t);
 cursor_t* table_find(table_t* t, u32 key);
-pager_t* pager_open(const char* fname);
-table_t* db_open(const char* fname);
+pager_t* pager_open(const char* fname, db_options_t* opts);
+int mmap_open(pager_t* pager);
+void* mmap_get_page(pager_t* pager, u64 page_num);
+void mmap_grow(pager_t* pager, u64 page_num);
+void mmap_grow_bitmaps(pager_t* pager);
+u8* grow_bitmap(u8* bitmap, size_t len, size_t new_len);
+void mmap_checkpoint(pager_t* pager);
+void mmap_close(pager_t* pager);
+table_t* db_open(const char* fname, db_options_t* opts);
+int parse_options(int argc, char* argv[], db_options_t* opts, const char** fname);
 input_buffer_t* new_input_buffer(void);
 u8 str_exactly_equal(const char* s1, const char* s2);
 meta_cmd_result_t exec_meta_cmd(input_buffer_t* in, table_t* t);
 prepare_result_t prepare_insert(input_buffer_t* in, statement* st);
+prepare_result_t prepare_update(input_buffer_t* in, statement* st);
+prepare_result_t prepare_row(char* curr_id, row_t* r);
 prepare_result_t prepare_statement(input_buffer_t* in, statement* st);
 execute_result_t exec_insert(statement* st, table_t* t);
+execute_result_t exec_update(statement* st, table_t* t);
 execute_result_t exec_select(statement* st, table_t* t);
+prepare_result_t prepare_delete(input_buffer_t* in, statement* st);
+execute_result_t exec_delete(statement* st, table_t* t);
+u32 table_delete_range(table_t* t, u32 first, u32 last);
 execute_result_t exec_statement(statement* st, table_t* t);
 void print_constants(void);
-u32 get_unused_page_num(pager_t* pager);
+void print_pager_stats(pager_t* pager);
+u64 get_unused_page_num(pager_t* pager);
 
 // general node operations
-void create_new_root(table_t* t, u32 right_child_page_num);
+void create_new_root(table_t* t, u64 right_child_page_num);
 node_type_t get_node_type(void* node);
 void set_node_type(void* node, node_type_t type);
 bool is_node_root(void* node);
 void set_node_root(void* node, bool is_root);
-u32 get_node_max_key(pager_t* pager, void* node);
-u32* node_parent(void* node);
+u32 get_node_max_key(void* node);
+void update_ancestor_max_keys(pager_t* pager, void* node, u32 key);
+void lower_ancestor_max_keys(pager_t* pager, void* node, u32 old_max, u32 new_max);
+void reparent_node(pager_t* pager, u64 page_num, u64 parent_page_num);
+void node_rebalance(table_t* t, u64 page_num);
+void node_merge(table_t* t, u64 parent_page_num, u32 index);
+void node_redistribute(table_t* t, u64 parent_page_num, u32 index);
+void collapse_root(table_t* t);
+u64* node_parent(void* node);
 void indent(u32 level);
-void print_tree(pager_t* pager, u32 page_num, u32 indentation_level);
+void print_tree(pager_t* pager, u64 page_num, u32 indentation_level);
 
 // access & control leaf node fields
 void init_leaf_node(void* node);
@@ -242,20 +744,49 @@ void* leaf_node_cell(void* node, u32 cell_num);
 u32* leaf_node_key(void* node, u32 cell_num);
 void* leaf_node_value(void* node, u32 cell_num);
 void leaf_node_insert(cursor_t* c, u32 key, row_t* value);
-cursor_t* leaf_node_find(table_t* t, u32 page_num, u32 key);
+cursor_t* leaf_node_find(table_t* t, u64 page_num, u32 key);
 void leaf_node_split_and_insert(cursor_t* c, u32 key, row_t* value);
-u32* leaf_node_next_leaf(void* node);
+void leaf_node_delete(cursor_t* c, u32 count);
+u64* leaf_node_next_leaf(void* node);
 bool is_last_leaf_node(void* node);
 
 // access and control internal node fields
 void init_internal_node(void* node);
-u32* internal_node_left_child(void* node, u32 child_num);
-u32* internal_node_right_child(void* node);
-u32* internal_node_cell(void* node, u32 cell_num);
+u64* internal_node_left_child(void* node, u32 child_num);
+u64* internal_node_right_child(void* node);
+u64* internal_node_cell(void* node, u32 cell_num);
 u32* internal_node_num_keys(void* node);
+u32* internal_node_max_key(void* node);
 u32* internal_node_key(void* node, u32 key_num);
-cursor_t* internal_node_find(table_t* t, u32 page_num, u32 key);
+cursor_t* internal_node_find(table_t* t, u64 page_num, u32 key);
 void update_internal_node_key(void* node, u32 old_key, u32 new_key);
 u32 internal_node_find_child(void* node, u32 key);
-void internal_node_insert(table_t* t, u32 parent_page_num, u32 child_page_num);
-void internal_node_split_and_insert(table_t* t, u32 parent_page_num, u32 child_page_num);
\ No newline at end of file
+u32 internal_node_child_index(void* node, u64 child_page_num);
+void internal_node_insert(table_t* t, u64 parent_page_num, u64 child_page_num);
+void internal_node_split_and_insert(table_t* t, u64 parent_page_num, u64 child_page_num);
+u64 internal_split_child(internal_split_t* split, u32 index, u32* max_key);
+
+// bulk-building trees
+void tree_builder_init(tree_builder_t* b, pager_t* pager, u64 num_rows, u32 leaf_fill);
+int tree_builder_add(tree_builder_t* b, u32 key, void* value);
+void tree_builder_push(tree_builder_t* b, u32 level, u64 child_page_num, u32 max_key);
+int tree_builder_finish(tree_builder_t* b);
+u64 tree_level_node(tree_level_t* level, u64 item);
+u64 tree_level_first_item(tree_level_t* level, u64 node);
+u64 tree_builder_parent(tree_builder_t* b, u32 level, u64 node);
+u64 db_rebuild(table_t* t, row_t* rows, u64* order, u64 num_rows, u32 leaf_fill);
+void db_vacuum(table_t* t);
+int compare_keys(const void* a, const void* b);
+int db_bulk_load(table_t* t, row_t* rows, u64 num_rows, u32 fill_percent);
+meta_cmd_result_t exec_load_cmd(char* arg, table_t* t);
+int sync_parent_dir(const char* path);
+
+// online backup
+int pager_backup_start(pager_t* pager, const char* path);
+int pager_backup_step(pager_t* pager, u32 max_pages);
+void pager_backup_changed(pager_t* pager, u64 page_num);
+void pager_backup_read_page(pager_t* pager, u64 page_num, void* page);
+int pager_backup_write_page(pager_t* pager, u64 page_num);
+int pager_backup_finish(pager_t* pager);
+void pager_backup_end(pager_t* pager);
+meta_cmd_result_t exec_backup_cmd(const char* args, table_t* t);
\ No newline at end of file
@@ -0,0 +1,241 @@
+/*
+    MIT License
+
+    Copyright (c) 2024 winterrdog
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef _SQLYTE_LZ_H
+#define _SQLYTE_LZ_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+** A small LZ77 codec for pages, laid out like an LZ4 block: a stream of
+** sequences, each one a token byte( literal count in the high nibble, match
+** length - 4 in the low one, 15 meaning "more bytes follow" ), the literals,
+** then a 2 byte little-endian offset back into what's been decoded so far.
+** The last sequence is literals only.
+**
+** It's tuned for what our pages look like: rows padded out with zeros, which
+** turn into one long overlapping match each.
+*/
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static uint32_t lz_read32(const unsigned char* p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t seq) { return (seq * 2654435761u) >> (32 - LZ_HASH_BITS); }
+
+// writes a length that didn't fit in its nibble, 255 at a time
+static unsigned char* lz_put_len(unsigned char* op, unsigned char* end, size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        if (op == end) {
+            return NULL;
+        }
+        *op++ = 255;
+    }
+    if (op == end) {
+        return NULL;
+    }
+    *op++ = (unsigned char)len;
+
+    return op;
+}
+
+static unsigned char* lz_put_sequence(unsigned char* op, unsigned char* end,
+    const unsigned char* lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    unsigned char* token;
+
+    if (op == end) {
+        return NULL;
+    }
+    token = op++;
+    *token = (lit_len < 15 ? lit_len : 15) << 4;
+    if (lit_len >= 15 && !(op = lz_put_len(op, end, lit_len - 15))) {
+        return NULL;
+    }
+
+    if ((size_t)(end - op) < lit_len) {
+        return NULL;
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    // the last sequence has no match
+    if (!match_len) {
+        return op;
+    }
+
+    if (end - op < 2) {
+        return NULL;
+    }
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+
+    match_len -= LZ_MIN_MATCH;
+    *token |= match_len < 15 ? match_len : 15;
+    if (match_len >= 15 && !(op = lz_put_len(op, end, match_len - 15))) {
+        return NULL;
+    }
+
+    return op;
+}
+
+/*
+** Returns the compressed size, or 0 if it doesn't fit in "dst_cap" bytes.
+** "src_len" can't be over 64K.
+*/
+static size_t lz_compress(const void* src, size_t src_len, void* dst, size_t dst_cap)
+{
+    uint32_t table[1 << LZ_HASH_BITS]; // position + 1 of the last 4 bytes with that hash
+    const unsigned char *in = src, *anchor = src;
+    unsigned char *op = dst, *end = op + dst_cap;
+    size_t ip, ref, len;
+    uint32_t h;
+
+    memset(table, 0x0, sizeof(table));
+    for (ip = 0; ip + LZ_MIN_MATCH <= src_len;) {
+        h = lz_hash(lz_read32(in + ip));
+        ref = table[h];
+        table[h] = ip + 1;
+
+        if (!ref-- || ip - ref > LZ_MAX_OFFSET || lz_read32(in + ref) != lz_read32(in + ip)) {
+            ip++;
+            continue;
+        }
+
+        for (len = LZ_MIN_MATCH; ip + len < src_len && in[ref + len] == in[ip + len];) {
+            len++;
+        }
+
+        op = lz_put_sequence(op, end, anchor, in + ip - anchor, ip - ref, len);
+        if (!op) {
+            return 0;
+        }
+
+        ip += len;
+        anchor = in + ip;
+    }
+
+    op = lz_put_sequence(op, end, anchor, in + src_len - anchor, 0, 0);
+    if (!op) {
+        return 0;
+    }
+
+    return op - (unsigned char*)dst;
+}
+
+// reads a length that didn't fit in its nibble, -1 if the input runs out
+static long lz_get_len(const unsigned char** ip, const unsigned char* end)
+{
+    long len = 0;
+    unsigned char b;
+
+    do {
+        if (*ip == end) {
+            return -1;
+        }
+        b = *(*ip)++;
+        len += b;
+    } while (b == 255);
+
+    return len;
+}
+
+/*
+** Returns the decompressed size, or -1 if "src" isn't a valid stream or
+** decompresses to more than "dst_cap" bytes.
+*/
+static long lz_decompress(const void* src, size_t src_len, void* dst, size_t dst_cap)
+{
+    const unsigned char *ip = src, *end = ip + src_len;
+    unsigned char *out = dst, *op = dst;
+    size_t lit_len, match_len, offset;
+    unsigned char token;
+    long extra;
+
+    while (ip != end) {
+        token = *ip++;
+
+        lit_len = token >> 4;
+        if (lit_len == 15) {
+            if ((extra = lz_get_len(&ip, end)) < 0) {
+                return -1;
+            }
+            lit_len += extra;
+        }
+        if ((size_t)(end - ip) < lit_len || dst_cap - (op - out) < lit_len) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len, op += lit_len;
+
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t)(op - out)) {
+            return -1;
+        }
+
+        match_len = token & 15;
+        if (match_len == 15) {
+            if ((extra = lz_get_len(&ip, end)) < 0) {
+                return -1;
+            }
+            match_len += extra;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (dst_cap - (op - out) < match_len) {
+            return -1;
+        }
+
+        // the match can overlap what it's copying, e.g. a run of zeros
+        if (offset >= match_len) {
+            memcpy(op, op - offset, match_len);
+            op += match_len;
+        } else {
+            for (; match_len; --match_len, ++op) {
+                *op = *(op - offset);
+            }
+        }
+    }
+
+    return op - out;
+}
+
+#endif
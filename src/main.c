@@ -23,15 +23,38 @@
 */
 #include "db.h"
 
-// todo: implement deleting records
-
 int main(int argc, char* argv[])
 {
     const char* fname;
-
-    if (argc != 2) {
-        printf("you must supply a database filename.\n");
-        printf("usage: %s <db_file>\n", argv[0]);
+    db_options_t opts;
+
+    if (parse_options(argc, argv, &opts, &fname) < 0) {
+        printf("usage: %s [options] <db_file>\n", argv[0]);
+        printf("options:\n");
+        printf("\t--frames=<n>     number of pages the buffer pool can hold( default %d, "
+               "min %d ).\n",
+            DEFAULT_POOL_FRAMES, MIN_POOL_FRAMES);
+        printf("\t--extent=<n>     pages the db file grows by at a time, allocated up front( "
+               "default %d, 0 to turn it off ).\n",
+            DEFAULT_EXTENT_PAGES);
+        printf("\t--page-size=<n>  page size of a new db file, a power of 2 from %d to "
+               "%d( default %d ).\n",
+            MIN_PAGE_SIZE, MAX_PAGE_SIZE, DEFAULT_PAGE_SIZE);
+        printf("\t--mmap           read pages straight out of a memory-mapped db file "
+               "instead of the buffer pool.\n");
+        printf("\t--io-uring       batch page reads and write-backs thru io_uring when the "
+               "kernel supports it.\n");
+        printf("\t--compress       compress pages written to the db file, needs pages of "
+               "8192 bytes and up.\n");
+        printf("\t--direct         bypass the kernel's page cache( O_DIRECT ), the buffer "
+               "pool is the only cache.\n");
+        printf("\t--sync=<mode>    off, normal or full( default ), see .sync in the shell.\n");
+        printf("\t--verify=<mode>  when pages read from disk get their checksum checked: "
+               "read( default ), lazy or check.\n");
+        printf("\t--warm           save the buffer pool's pages to <db>-warm at exit and "
+               "read them back in at startup.\n");
+        printf("\t--no-wal         skip the write-ahead log, changes only reach the db file "
+               "when pages are evicted or at exit.\n");
 
         return EXIT_FAILURE;
     }
@@ -39,32 +62,170 @@ int main(int argc, char* argv[])
     // register cleanup function
     atexit(xfree_all);
 
-    fname = argv[1], run_repl(fname);
+    run_repl(fname, &opts);
 
     return EXIT_SUCCESS;
 }
 
+int parse_options(int argc, char* argv[], db_options_t* opts, const char** fname)
+{
+    const char* opt_frames = "--frames=";
+    const char* opt_page_size = "--page-size=";
+    const char* opt_extent = "--extent=";
+    const char* opt_sync = "--sync=";
+    const char* opt_verify = "--verify=";
+    const char* opt_max_keys = "--max-keys=";
+    int i, frames, page_size, extent_pages, max_keys;
+
+    opts->pool_frames = DEFAULT_POOL_FRAMES;
+    opts->mode = PAGER_MODE_BUFFERED;
+    opts->io_uring = false;
+    opts->direct = false;
+    opts->compress = false;
+    opts->extent_pages = DEFAULT_EXTENT_PAGES;
+    opts->sync_mode = SYNC_MODE_FULL;
+    opts->verify_mode = VERIFY_MODE_READ;
+    opts->wal = true;
+    opts->warm_start = false;
+    opts->page_size = DEFAULT_PAGE_SIZE;
+    opts->internal_max_keys = 0;
+    *fname = NULL;
+
+    for (i = 1; i != argc; ++i) {
+        if (str_exactly_equal(argv[i], "--io-uring")) {
+            opts->io_uring = true;
+            continue;
+        }
+        if (str_exactly_equal(argv[i], "--compress")) {
+            opts->compress = true;
+            continue;
+        }
+        if (str_exactly_equal(argv[i], "--direct")) {
+            opts->direct = true;
+            continue;
+        }
+        if (str_exactly_equal(argv[i], "--warm")) {
+            opts->warm_start = true;
+            continue;
+        }
+        if (str_exactly_equal(argv[i], "--no-wal")) {
+            opts->wal = false;
+            continue;
+        }
+        if (str_exactly_equal(argv[i], "--mmap")) {
+            opts->mode = PAGER_MODE_MMAP;
+            continue;
+        }
+
+        if (!strncmp(argv[i], opt_frames, strlen(opt_frames))) {
+            frames = atoi(argv[i] + strlen(opt_frames));
+            if (frames < MIN_POOL_FRAMES) {
+                printf("the buffer pool needs at least %d frames.\n", MIN_POOL_FRAMES);
+                return -1;
+            }
+
+            opts->pool_frames = frames;
+            continue;
+        }
+        if (!strncmp(argv[i], opt_sync, strlen(opt_sync))) {
+            if (parse_sync_mode(argv[i] + strlen(opt_sync), &opts->sync_mode) < 0) {
+                printf("sync mode must be off, normal or full.\n");
+                return -1;
+            }
+            continue;
+        }
+        if (!strncmp(argv[i], opt_verify, strlen(opt_verify))) {
+            if (parse_verify_mode(argv[i] + strlen(opt_verify), &opts->verify_mode) < 0) {
+                printf("verify mode must be read, lazy or check.\n");
+                return -1;
+            }
+            continue;
+        }
+        if (!strncmp(argv[i], opt_extent, strlen(opt_extent))) {
+            extent_pages = atoi(argv[i] + strlen(opt_extent));
+            if (extent_pages < 0) {
+                printf("the extent can't be negative.\n");
+                return -1;
+            }
+
+            opts->extent_pages = extent_pages;
+            continue;
+        }
+        if (!strncmp(argv[i], opt_max_keys, strlen(opt_max_keys))) {
+            max_keys = atoi(argv[i] + strlen(opt_max_keys));
+            if (max_keys < MIN_INTERNAL_NODE_KEYS) {
+                printf("internal nodes need room for at least %d keys.\n",
+                    MIN_INTERNAL_NODE_KEYS);
+                return -1;
+            }
+
+            opts->internal_max_keys = max_keys;
+            continue;
+        }
+        if (!strncmp(argv[i], opt_page_size, strlen(opt_page_size))) {
+            page_size = atoi(argv[i] + strlen(opt_page_size));
+            if (page_size < 0 || !is_valid_page_size(page_size)) {
+                printf("page size must be a power of 2 between %d and %d.\n", MIN_PAGE_SIZE,
+                    MAX_PAGE_SIZE);
+                return -1;
+            }
+
+            opts->page_size = page_size;
+            continue;
+        }
+
+        if (argv[i][0] == '-' || *fname) {
+            printf("unrecognized argument '%s'.\n", argv[i]);
+            return -1;
+        }
+
+        *fname = argv[i];
+    }
+
+    if (opts->direct && opts->mode == PAGER_MODE_MMAP) {
+        printf("--direct and --mmap can't be used together.\n");
+        return -1;
+    }
+    if (opts->compress && opts->mode == PAGER_MODE_MMAP) {
+        printf("--compress and --mmap can't be used together.\n");
+        return -1;
+    }
+
+    if (!*fname) {
+        printf("you must supply a database filename.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 void print_row(row_t* r) { printf("( %d, %s, %s )\n", r->id, r->username, r->email); }
 
-void* get_page(pager_t* pager, u32 page_num)
+void* get_page(pager_t* pager, u64 page_num)
 {
-    void* page;
-    u32 num_pages;
-    off_t off;
+    frame_t* frame;
+    u64 num_pages;
+    u32 frame_num;
     ssize_t bytes_read;
 
-    if (page_num > TABLE_MAX_PAGES) {
-        printf("tried to fetch a page out of bounds. %d > %d\n", page_num, TABLE_MAX_PAGES);
-        exit(EXIT_FAILURE);
+    if (pager->mode == PAGER_MODE_MMAP) {
+        return mmap_get_page(pager, page_num);
     }
 
-    if (pager->pages[page_num] != NULL) {
+    frame = pager_find_frame(pager, page_num);
+    if (frame) {
         // a cache hit
-        return pager->pages[page_num];
+        frame->referenced = true;
+        if (frame->unverified) {
+            // read ahead in lazy mode, this is its first use
+            pager_verify_frame(frame);
+        }
+        return frame->data;
     }
 
-    // cache miss. allocate memory and load from file
-    page = xcalloc(PAGE_SIZE, 1);
+    // cache miss. recycle a frame and load the page from file into it
+    frame = pager_get_victim(pager);
+    memset(frame->data, 0x0, PAGE_SIZE);
     num_pages = pager->file_len / PAGE_SIZE;
 
     // we might hv saved a partial page at the end of file
@@ -72,28 +233,346 @@ void* get_page(pager_t* pager, u32 page_num)
         num_pages++;
     }
 
-    // fetch page from file
-    if (page_num <= num_pages) {
-        off = lseek(pager->fd, page_num * PAGE_SIZE, SEEK_SET);
-        if (off < 0) {
-            printf("failed to reposition for the current page.\n");
-            exit(EXIT_FAILURE);
-        }
-
-        bytes_read = read(pager->fd, page, PAGE_SIZE);
+    // fetch page from the log if it changed since the last checkpoint,
+    // otherwise from the db file
+    if (pager->wal && (frame_num = wal_index_lookup(pager->wal, page_num)) != WAL_NO_FRAME) {
+        wal_read_page(pager->wal, frame_num, frame->data);
+    } else if (page_num < num_pages) {
+        bytes_read = pread(pager->fd, frame->data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
         if (bytes_read < 0) {
             printf("failed to read in data from file: %d\n", errno);
             exit(EXIT_FAILURE);
         }
+        pager_inflate(pager, page_num, frame->data);
+    }
+
+    pager_install_frame(pager, frame, page_num);
+    if (frame->unverified) {
+        pager_verify_frame(frame);
     }
 
-    pager->pages[page_num] = page;
+    return frame->data;
+}
+
+// hooks a freshly filled frame up to the page table
+void pager_install_frame(pager_t* pager, frame_t* frame, u64 page_num)
+{
+    u32 bucket;
+
+    frame->page_num = page_num;
+    frame->referenced = true;
+    frame->dirty = false;
+    frame->unverified = pager->verify_mode != VERIFY_MODE_CHECK;
+
+    bucket = PAGE_TABLE_BUCKET(pager, page_num);
+    frame->hash_next = pager->buckets[bucket];
+    pager->buckets[bucket] = frame - pager->frames;
 
     if (page_num >= pager->num_pages) {
         pager->num_pages = page_num + 1;
     }
+}
+
+/*
+    reads a batch of pages into the buffer pool before anybody asks for them.
+    with io_uring all the reads are handed to the kernel in one submission and
+    run in parallel, otherwise this is a no-op and get_page() reads them on
+    demand like it always did
+*/
+void pager_prefetch(pager_t* pager, u64* page_nums, u32 count)
+{
+    frame_t* frame;
+    u64 on_disk;
+    u32 i, queued;
+
+    if (!pager->ring) {
+        return;
+    }
+
+    on_disk = pager->file_len / PAGE_SIZE;
+    for (i = 0, queued = 0; i != count && queued != URING_ENTRIES; ++i) {
+        if (page_nums[i] >= on_disk || pager_find_frame(pager, page_nums[i])) {
+            continue;
+        }
+        // the db file holds a stale copy of pages still in the log
+        if (pager->wal && wal_index_lookup(pager->wal, page_nums[i]) != WAL_NO_FRAME) {
+            continue;
+        }
+
+        frame = pager_get_victim(pager);
+        pager_install_frame(pager, frame, page_nums[i]);
+
+        pager->ring_iov[queued].iov_base = frame->data;
+        pager->ring_iov[queued].iov_len = PAGE_SIZE;
+        uring_queue_readv(pager->ring, pager->fd, &pager->ring_iov[queued], 1,
+            (off_t)page_nums[i] * PAGE_SIZE, frame - pager->frames);
+        queued++;
+    }
+
+    if (queued && uring_submit_and_wait(pager->ring, pager_read_done, pager) < 0) {
+        printf("failed to submit page reads, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    hands pages a scan will want soon to whoever does our reads. with io_uring
+    we read them into the pool ourselves, otherwise the kernel is asked to pull
+    them into its page cache in the background so the pread() or page fault
+    that comes later doesn't have to wait for the disk
+*/
+void pager_readahead(pager_t* pager, u64* page_nums, u32 count)
+{
+    u64 on_disk, run_start;
+    u32 i, run_len;
+
+    if (pager->ring) {
+        // don't let a batch push out more than a quarter of the pool
+        if (count > pager->num_frames / 4) {
+            count = pager->num_frames / 4;
+        }
+        pager_prefetch(pager, page_nums, count);
+        pager->ra.num_pages += count;
+        return;
+    }
+    // there's no page cache to warm up
+    if (pager->direct) {
+        return;
+    }
+
+    // pages that sit next to each other in the file go in one hint
+    on_disk = pager->file_len / PAGE_SIZE;
+    run_start = INVALID_PAGE_NUM, run_len = 0;
+    for (i = 0; i != count; ++i) {
+        if (page_nums[i] >= on_disk) {
+            continue;
+        }
+        if (pager->mode == PAGER_MODE_BUFFERED && pager_find_frame(pager, page_nums[i])) {
+            continue;
+        }
+        // those are read from the log, not the db file
+        if (pager->wal && wal_index_lookup(pager->wal, page_nums[i]) != WAL_NO_FRAME) {
+            continue;
+        }
+
+        pager->ra.num_pages++;
+        if (run_len && page_nums[i] == run_start + run_len) {
+            run_len++;
+            continue;
+        }
+        if (run_len) {
+            pager_advise(pager, run_start, run_len);
+        }
+        run_start = page_nums[i], run_len = 1;
+    }
+    if (run_len) {
+        pager_advise(pager, run_start, run_len);
+    }
+}
+
+// it's only a hint, so nothing to do if the kernel doesn't take it
+void pager_advise(pager_t* pager, u64 first_page_num, u32 num_pages)
+{
+    off_t offset = (off_t)first_page_num * PAGE_SIZE;
+    size_t len = (size_t)num_pages * PAGE_SIZE;
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        if (offset + len <= pager->map_len) {
+            madvise(pager->map + offset, len, MADV_WILLNEED);
+        }
+        return;
+    }
+
+    posix_fadvise(pager->fd, offset, len, POSIX_FADV_WILLNEED);
+}
+
+void pager_read_done(void* ctx, uint64_t frame_idx, int res)
+{
+    pager_t* pager = ctx;
+    frame_t* frame = &pager->frames[frame_idx];
+
+    if (res < 0) {
+        printf("failed to read in data from file: %d\n", -res);
+        exit(EXIT_FAILURE);
+    }
+
+    // whatever is past the end of file reads as zeros
+    memset(frame->data + res, 0x0, PAGE_SIZE - res);
+    pager_inflate(pager, frame->page_num, frame->data);
+
+    if (pager->verify_mode == VERIFY_MODE_READ) {
+        pager_verify_frame(frame);
+    }
+}
+
+void pager_write_done(void* ctx, uint64_t run, int res)
+{
+    pager_t* pager = ctx;
+    u64 first_page_num = run >> 16;
+    u32 run_len = run & 0xffff;
+    off_t end;
+
+    if (res < 0) {
+        printf("error writing page cache to disk: %d\n", -res);
+        exit(EXIT_FAILURE);
+    }
+    if ((size_t)res != run_len * PAGE_SIZE) {
+        printf("short write of pages %llu..%llu to disk.\n", first_page_num,
+            first_page_num + run_len - 1);
+        exit(EXIT_FAILURE);
+    }
+
+    end = ((off_t)first_page_num + run_len) * PAGE_SIZE;
+    if (end > pager->file_len) {
+        pager->file_len = end;
+    }
+    if (pager->file_len > pager->alloc_len) {
+        pager->alloc_len = pager->file_len;
+    }
+}
+
+/*
+    b-tree code writes straight thru the pointers handed out by get_page(), so
+    whoever changes a page has to flag it here. only flagged pages are ever
+    written back
+*/
+void pager_mark_dirty(pager_t* pager, u64 page_num)
+{
+    frame_t* frame;
+
+    if (pager->backup) {
+        pager_backup_changed(pager, page_num);
+    }
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        if (!(pager->dirty_map[page_num / 8] & (1 << (page_num % 8)))) {
+            pager->dirty_map[page_num / 8] |= (1 << (page_num % 8));
+            pager->num_dirty++;
+        }
+        return;
+    }
+
+    frame = pager_find_frame(pager, page_num);
+    if (!frame) {
+        printf("tried to mark a page that's not in the buffer pool as dirty\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!frame->dirty) {
+        frame->dirty = true;
+        pager->num_dirty++;
+    }
+}
+
+/*
+    get_page() hands out pointers into the buffer pool that only stay valid
+    until the frame is recycled, which can happen on any later get_page().
+    code that holds on to a page while it reads others in has to pin it
+    first, and unpin it once it's done with it. pins nest
+*/
+void* pager_pin(pager_t* pager, u64 page_num)
+{
+    void* page;
+
+    page = get_page(pager, page_num);
+    if (pager->mode == PAGER_MODE_MMAP) {
+        // mapped pages never move
+        return page;
+    }
+
+    pager_find_frame(pager, page_num)->pin_count++;
+    pager->num_pinned++;
+
+    return page;
+}
+
+void pager_unpin(pager_t* pager, u64 page_num)
+{
+    frame_t* frame;
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        return;
+    }
+
+    frame = pager_find_frame(pager, page_num);
+    if (!frame || !frame->pin_count) {
+        printf("tried to unpin page %llu which isn't pinned\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    frame->pin_count--;
+    pager->num_pinned--;
+}
+
+frame_t* pager_find_frame(pager_t* pager, u64 page_num)
+{
+    u32 i;
+
+    i = pager->buckets[PAGE_TABLE_BUCKET(pager, page_num)];
+    while (i != NO_FRAME) {
+        if (pager->frames[i].page_num == page_num) {
+            return &pager->frames[i];
+        }
+
+        i = pager->frames[i].hash_next;
+    }
+
+    return NULL;
+}
+
+/*
+    picks a frame to (re)use with the CLOCK policy: sweep the frames in a
+    circle, giving recently used ones a second chance by clearing their
+    "referenced" bit, and take the first free or unreferenced frame found.
+    a dirty victim is written back before it's handed out. pinned frames are
+    passed over.
+*/
+frame_t* pager_get_victim(pager_t* pager)
+{
+    frame_t* frame;
+    u32 *link, frame_idx, swept;
+
+    for (swept = 0;; ++swept) {
+        // two full turns clear every "referenced" bit, if nothing turned up
+        // by then everything is pinned
+        if (swept == 2 * pager->num_frames) {
+            printf("every frame in the buffer pool is pinned.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        frame_idx = pager->clock_hand;
+        frame = &pager->frames[frame_idx];
+        pager->clock_hand = (pager->clock_hand + 1) % pager->num_frames;
+
+        if (frame->page_num == INVALID_PAGE_NUM) {
+            // never used
+            return frame;
+        }
+        if (frame->pin_count) {
+            continue;
+        }
+        if (!frame->referenced) {
+            break;
+        }
+
+        frame->referenced = false;
+    }
+
+    if (frame->dirty) {
+        pager_flush(pager, frame->page_num);
+    }
+
+    // unlink frame from the page table
+    link = &pager->buckets[PAGE_TABLE_BUCKET(pager, frame->page_num)];
+    while (*link != frame_idx) {
+        link = &pager->frames[*link].hash_next;
+    }
+    *link = frame->hash_next;
+
+    frame->page_num = INVALID_PAGE_NUM;
+    frame->hash_next = NO_FRAME;
 
-    return pager->pages[page_num];
+    return frame;
 }
 
 void serialize_row(row_t* src, void* dest)
@@ -137,7 +616,7 @@ cursor_t* table_start(table_t* table)
 
 void* cursor_value(cursor_t* c)
 {
-    u32 page_num;
+    u64 page_num;
     void* page;
 
     page_num = c->page_num;
@@ -148,7 +627,7 @@ void* cursor_value(cursor_t* c)
 
 void cursor_advance(cursor_t* c)
 {
-    u32 page_num, next_page_num;
+    u64 page_num, next_page_num;
     void* node;
 
     page_num = c->page_num;
@@ -166,18 +645,124 @@ void cursor_advance(cursor_t* c)
         c->end_of_table = true;
     } else {
         next_page_num = *leaf_node_next_leaf(node);
+        cursor_readahead(c, node, next_page_num);
 
         c->page_num = next_page_num;
         c->cell_num = 0;
     }
 }
 
-pager_t* pager_open(const char* fname)
+/*
+    readahead. a scan steps from leaf to leaf thru the next-leaf pointers, one
+    get_page() at a time. once it's done that a few times in a row we can tell
+    which leaves it wants next, so have them read in before it gets there
+    instead of waiting on the disk for every leaf.
+
+    like the kernel's readahead for files, the window starts small and doubles
+    every time the scan reaches the middle of the last one, so the next window
+    is on its way while the scan works thru the rest of the current one
+*/
+void cursor_readahead(cursor_t* c, void* leaf, u64 next_page_num)
+{
+    readahead_t* ra = &c->table->pager->ra;
+    u64 page_nums[READAHEAD_MAX_WINDOW];
+    u32 count, last_key;
+
+    if (c->page_num != ra->last_page_num) {
+        // a new scan, or some other cursor went somewhere else in between
+        ra->run = 0;
+        ra->steps_left = 0;
+        ra->window = READAHEAD_MIN_WINDOW;
+    }
+    ra->last_page_num = next_page_num;
+
+    if (++ra->run < READAHEAD_MIN_RUN) {
+        return;
+    }
+    if (ra->steps_left && --ra->steps_left) {
+        return;
+    }
+    if (!*leaf_node_num_cells(leaf)) {
+        return;
+    }
+
+    last_key = *leaf_node_key(leaf, *leaf_node_num_cells(leaf) - 1);
+    count = collect_next_leaves(c->table, last_key, page_nums, ra->window);
+
+    // the tree doesn't agree with the leaf chain, don't guess
+    if (!count || page_nums[0] != next_page_num) {
+        return;
+    }
+
+    pager_readahead(c->table->pager, page_nums, count);
+
+    ra->steps_left = count / 2;
+    if (ra->window < READAHEAD_MAX_WINDOW) {
+        ra->window *= 2;
+    }
+}
+
+/*
+    fills "page_nums" with up to "max_count" leaves that follow the one holding
+    "key", in key order. it goes down from the root to that leaf and then walks
+    the level above the leaves from left to right, so only internal nodes are
+    read( and those are nearly always cached ), never the leaves themselves
+*/
+u32 collect_next_leaves(table_t* t, u32 key, u64* page_nums, u32 max_count)
+{
+    u64 path[READAHEAD_MAX_DEPTH]; // internal nodes from the root down
+    u32 next_child[READAHEAD_MAX_DEPTH]; // next child to visit in each of them
+    u32 depth, leaf_depth, count;
+    u64 page_num;
+    void* node;
+
+    page_num = t->root_page_num;
+    for (depth = 0;; ++depth) {
+        node = get_page(t->pager, page_num);
+        if (get_node_type(node) == NODE_LEAF) {
+            break;
+        }
+        if (depth == READAHEAD_MAX_DEPTH) {
+            return 0;
+        }
+
+        path[depth] = page_num;
+        next_child[depth] = internal_node_find_child(node, key);
+        page_num = *internal_node_left_child(node, next_child[depth]++);
+    }
+
+    // leaves should all sit at the same depth, so anything found there is
+    // taken to be a leaf without reading it
+    leaf_depth = depth;
+
+    for (count = 0; depth && count != max_count;) {
+        node = get_page(t->pager, path[depth - 1]);
+        if (next_child[depth - 1] > *internal_node_num_keys(node)) {
+            // done with this node, carry on in its parent
+            depth--;
+            continue;
+        }
+
+        page_num = *internal_node_left_child(node, next_child[depth - 1]++);
+        if (depth == leaf_depth
+            || get_node_type(get_page(t->pager, page_num)) == NODE_LEAF) {
+            page_nums[count++] = page_num;
+        } else {
+            path[depth] = page_num;
+            next_child[depth++] = 0;
+        }
+    }
+
+    return count;
+}
+
+pager_t* pager_open(const char* fname, db_options_t* opts)
 {
     int fd;
     off_t file_len;
     pager_t* pager;
-    u32 i;
+    db_header_t header;
+    u32 i, num_frames;
 
     // open file in r/w mode or creating one if not existent
     // with read & write permissions for current user
@@ -187,44 +772,2148 @@ pager_t* pager_open(const char* fname)
         exit(EXIT_FAILURE);
     }
 
-    // set up pager
-    file_len = lseek(fd, 0, SEEK_END);
-    if ((file_len % PAGE_SIZE) != 0) {
-        printf("db file is not a whole number of pages. Corrupt database file.\n");
-        exit(EXIT_FAILURE);
+    // an existing db keeps the page size it was created with, the rest of
+    // its header is read further down
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header)
+        && header.magic == DB_HEADER_MAGIC && is_valid_page_size(header.page_size)) {
+        set_page_size(header.page_size);
+    } else {
+        set_page_size(opts->page_size);
     }
 
     pager = xmalloc(sizeof(pager_t));
-    pager->file_len = file_len, pager->fd = fd;
-    pager->num_pages = (file_len / PAGE_SIZE);
-    for (i = 0; i != TABLE_MAX_PAGES; ++i) {
-        pager->pages[i] = NULL;
+    pager->fd = fd;
+    pager->sync_mode = opts->sync_mode;
+    pager->verify_mode = opts->verify_mode;
+    pager->compress = opts->compress;
+    crc32c_init();
+
+    // the log has to be replayed before we look at the db file
+    pager->wal = NULL;
+    if (opts->wal && wal_open(pager, fname) < 0) {
+        printf("unable to open the write-ahead log, %d.\n", errno);
+        exit(EXIT_FAILURE);
     }
 
-    return pager;
+    // only now is the page size settled, the log may have changed it
+    pager->slot_buf = xmemalign(PAGE_SIZE, PAGE_SIZE);
+
+    // a compressed page still takes up at least one whole slot block, one that
+    // big can't come out any smaller
+    if (pager->compress && PAGE_SIZE <= SLOT_BLOCK_SIZE) {
+        printf("--compress needs pages bigger than %d bytes, this db has %d byte pages. "
+               "pages are stored uncompressed.\n",
+            SLOT_BLOCK_SIZE, PAGE_SIZE);
+        pager->compress = false;
+    }
+    if (opts->internal_max_keys > INTERNAL_NODE_MAX_KEYS) {
+        printf("--max-keys can't be more than the %d keys that fit in a %d byte page.\n",
+            INTERNAL_NODE_MAX_KEYS, PAGE_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    pager->internal_max_keys = opts->internal_max_keys;
+
+    // set up pager
+    file_len = lseek(fd, 0, SEEK_END);
+    if ((file_len % PAGE_SIZE) != 0) {
+        printf("db file is not a whole number of pages. Corrupt database file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pager->file_len = file_len, pager->alloc_len = file_len;
+    pager->extent_pages = opts->extent_pages;
+    pager->num_pages = 0;
+    pager->num_dirty = 0;
+    pager->num_pinned = 0;
+
+    pager->ra.last_page_num = INVALID_PAGE_NUM;
+    pager->ra.run = 0;
+    pager->ra.steps_left = 0;
+    pager->ra.window = READAHEAD_MIN_WINDOW;
+    pager->ra.num_pages = 0;
+
+    // everything else we need to know about the file is in its header, a new
+    // one gets its header from db_open()
+    memset(&pager->header, 0x0, sizeof(db_header_t));
+    if (file_len) {
+        pager_read_header(pager);
+
+        // whatever's past the last page is a preallocated tail left behind by
+        // a session that didn't get to trim it, it's all zeros
+        if (pager->file_len > (off_t)pager->num_pages * PAGE_SIZE) {
+            pager->file_len = (off_t)pager->num_pages * PAGE_SIZE;
+        }
+    }
+    pager->mode = opts->mode;
+
+    if (pager->mode == PAGER_MODE_MMAP && (pager->header.flags & DB_FLAG_COMPRESSED)) {
+        printf("db file has compressed pages, they can't be memory-mapped. using the buffer "
+               "pool instead.\n");
+        pager->mode = PAGER_MODE_BUFFERED;
+    }
+    if (pager->mode == PAGER_MODE_MMAP && mmap_open(pager) < 0) {
+        printf("unable to memory-map the db file, %d. falling back to the buffer "
+               "pool.\n",
+            errno);
+        pager->mode = PAGER_MODE_BUFFERED;
+    }
+
+    // set up the buffer pool, all frames start out free. mmap mode still
+    // carries an empty one so the pager looks the same to everybody else
+    num_frames = pager->mode == PAGER_MODE_MMAP ? 0 : opts->pool_frames;
+    pager->num_frames = num_frames, pager->clock_hand = 0;
+    pager->arena = xmemalign(PAGE_SIZE, (size_t)num_frames * PAGE_SIZE);
+    pager->frames = xmalloc(num_frames * sizeof(frame_t));
+    for (i = 0; i != num_frames; ++i) {
+        pager->frames[i].page_num = INVALID_PAGE_NUM;
+        pager->frames[i].hash_next = NO_FRAME;
+        pager->frames[i].pin_count = 0;
+        pager->frames[i].referenced = false;
+        pager->frames[i].dirty = false;
+        pager->frames[i].unverified = false;
+        pager->frames[i].data = pager->arena + ((size_t)i * PAGE_SIZE);
+    }
+
+    for (pager->num_buckets = 1; pager->num_buckets < num_frames;) {
+        pager->num_buckets <<= 1;
+    }
+    pager->buckets = xmalloc(pager->num_buckets * sizeof(u32));
+    for (i = 0; i != pager->num_buckets; ++i) {
+        pager->buckets[i] = NO_FRAME;
+    }
+    pager->flush_list = xmalloc(num_frames * sizeof(frame_t*));
+    pager->flush_iov = xmalloc(num_frames * sizeof(struct iovec));
+
+    // the log was replayed and the header read thru the page cache, from here
+    // on the db file only ever sees whole pages going to and from the pool
+    pager->direct = false;
+    if (opts->direct && pager_set_direct(pager) < 0) {
+        printf("direct I/O is unavailable, %d. falling back to the page cache.\n", errno);
+    }
+
+    // io_uring only helps when we do the reading ourselves
+    pager->ring = NULL;
+    if (opts->io_uring && pager->mode == PAGER_MODE_BUFFERED) {
+        pager->ring = xmalloc(sizeof(uring_t));
+        if (uring_open(pager->ring, URING_ENTRIES) < 0) {
+            printf("io_uring is unavailable, %d. falling back to synchronous I/O.\n",
+                errno);
+            xfree(pager->ring);
+            pager->ring = NULL;
+        }
+    }
+
+    // the pages that were in the pool last time are the ones we'll want first
+    pager->backup = NULL;
+    pager->warm_path = NULL;
+    if (opts->warm_start && pager->mode == PAGER_MODE_BUFFERED) {
+        pager->warm_path = xmalloc(strlen(fname) + sizeof("-warm"));
+        sprintf(pager->warm_path, "%s-warm", fname);
+    }
+    pager_warm_start(pager);
+
+    return pager;
+}
+
+/*
+    switches the db file over to O_DIRECT. reads and writes then have to cover
+    whole device blocks at block-aligned offsets and memory, which pages in the
+    arena always do
+*/
+int pager_set_direct(pager_t* pager)
+{
+    int flags;
+
+    flags = fcntl(pager->fd, F_GETFL);
+    if (flags < 0 || fcntl(pager->fd, F_SETFL, flags | O_DIRECT) < 0) {
+        return -1;
+    }
+    pager->direct = true;
+
+    // nothing's going to read the copies the kernel still holds
+    posix_fadvise(pager->fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    return 0;
+}
+
+/*
+    makes sure the db file has room for "num_pages" pages. it's grown a whole
+    extent at a time with fallocate(), so the blocks come out contiguous and
+    the filesystem updates its metadata once per extent instead of on every
+    write past the end of the file.
+
+    only the file's size changes, "file_len" still ends at the last page
+    written, so nobody goes reading the zeros in the preallocated tail
+*/
+void pager_reserve(pager_t* pager, u64 num_pages)
+{
+    off_t new_len;
+
+    if ((off_t)num_pages * PAGE_SIZE <= pager->alloc_len || !pager->extent_pages) {
+        return;
+    }
+
+    new_len = (off_t)((num_pages + pager->extent_pages - 1) / pager->extent_pages)
+        * pager->extent_pages * PAGE_SIZE;
+    if (fallocate(pager->fd, 0, pager->alloc_len, new_len - pager->alloc_len) < 0) {
+        // the filesystem can't do it( or is full ), so grow the file a write
+        // at a time like before. a real lack of space shows up on the write
+        pager->extent_pages = 0;
+        return;
+    }
+
+    pager->alloc_len = new_len;
+}
+
+// drops whatever part of the preallocated tail didn't get used
+void pager_trim(pager_t* pager)
+{
+    off_t used = (off_t)pager->num_pages * PAGE_SIZE;
+
+    if (pager->alloc_len <= used && pager->file_len <= used) {
+        return;
+    }
+    if (ftruncate(pager->fd, used) < 0) {
+        printf("failed to trim the db file, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    pager->file_len = used, pager->alloc_len = used;
+}
+
+/*
+    mmap mode: the whole db file is mapped into memory and get_page() hands out
+    pointers straight into the mapping, so pages are never copied out of the
+    kernel's page cache.
+
+    a big chunk of address space is reserved up front and the file is mapped at
+    its start, growing in place as new pages get added. pages never move, so
+    pointers handed out earlier stay valid.
+
+    the mapping is private. changed pages get a copy-on-write copy and only
+    reach the file when the pager writes them back, same as in buffered mode
+*/
+int mmap_open(pager_t* pager)
+{
+    void* map;
+
+    pager->map_reserved = MMAP_RESERVE_SIZE;
+    pager->map = mmap(NULL, pager->map_reserved, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pager->map == MAP_FAILED) {
+        return -1;
+    }
+
+    pager->map_len = 0;
+    pager->dirty_map = NULL, pager->verified_map = NULL, pager->dirty_map_len = 0;
+    if (pager->file_len == 0) {
+        return 0;
+    }
+
+    map = mmap(pager->map, pager->file_len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, pager->fd, 0);
+    if (map == MAP_FAILED) {
+        munmap(pager->map, pager->map_reserved);
+        return -1;
+    }
+
+    pager->map_len = pager->file_len;
+    mmap_grow_bitmaps(pager);
+
+    return 0;
+}
+
+void* mmap_get_page(pager_t* pager, u64 page_num)
+{
+    void* page;
+
+    if ((size_t)page_num * PAGE_SIZE >= pager->map_len) {
+        mmap_grow(pager, page_num);
+    }
+
+    if (page_num >= pager->num_pages) {
+        pager->num_pages = page_num + 1;
+    }
+
+    /*
+        there's no read to hook the checksum check to, the kernel faults the
+        page in when it's first touched. so it's checked the first time it's
+        handed out instead, whether the verify mode is read or lazy
+    */
+    page = pager->map + ((size_t)page_num * PAGE_SIZE);
+    if (pager->verify_mode != VERIFY_MODE_CHECK
+        && !(pager->verified_map[page_num / 8] & (1 << (page_num % 8)))) {
+        verify_page(page_num, page);
+        pager->verified_map[page_num / 8] |= (1 << (page_num % 8));
+    }
+
+    return page;
+}
+
+/*
+    extends the db file and its mapping so that "page_num" is mapped. the file
+    grows in chunks so adding pages one by one doesn't remap every time
+*/
+void mmap_grow(pager_t* pager, u64 page_num)
+{
+    size_t new_len;
+    void* map;
+
+    new_len = ((size_t)page_num + MMAP_GROW_PAGES) * PAGE_SIZE;
+    new_len -= new_len % ((size_t)MMAP_GROW_PAGES * PAGE_SIZE);
+    if (new_len > pager->map_reserved) {
+        printf("db file outgrew the address space reserved for mmap mode.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pager_reserve(pager, new_len / PAGE_SIZE);
+    if ((off_t)new_len > pager->alloc_len) {
+        if (ftruncate(pager->fd, new_len) < 0) {
+            printf("failed to grow the db file, %d.\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        pager->alloc_len = new_len;
+    }
+
+    map = mmap(pager->map + pager->map_len, new_len - pager->map_len,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, pager->fd, pager->map_len);
+    if (map == MAP_FAILED) {
+        printf("failed to grow the db file mapping, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    pager->map_len = new_len;
+    if ((off_t)new_len > pager->file_len) {
+        pager->file_len = new_len;
+    }
+    mmap_grow_bitmaps(pager);
+}
+
+// makes room in the dirty and verified page bitmaps for every mapped page
+void mmap_grow_bitmaps(pager_t* pager)
+{
+    size_t needed;
+
+    needed = (pager->map_len / PAGE_SIZE + 7) / 8;
+    if (needed <= pager->dirty_map_len) {
+        return;
+    }
+
+    pager->dirty_map = grow_bitmap(pager->dirty_map, pager->dirty_map_len, needed);
+    pager->verified_map = grow_bitmap(pager->verified_map, pager->dirty_map_len, needed);
+    pager->dirty_map_len = needed;
+}
+
+u8* grow_bitmap(u8* bitmap, size_t len, size_t new_len)
+{
+    u8* new_bitmap;
+
+    new_bitmap = xcalloc(new_len, 1);
+    if (bitmap) {
+        memcpy(new_bitmap, bitmap, len);
+        xfree(bitmap);
+    }
+
+    return new_bitmap;
+}
+
+void mmap_checkpoint(pager_t* pager)
+{
+    struct iovec iov[MAX_RUN_PAGES];
+    u64 page_num, run_start;
+    u32 run_len;
+
+    run_start = 0, run_len = 0;
+    for (page_num = 0; page_num != pager->num_pages && pager->num_dirty; ++page_num) {
+        if (!(pager->dirty_map[page_num / 8] & (1 << (page_num % 8)))) {
+            continue;
+        }
+
+        if (run_len && (page_num != run_start + run_len || run_len == MAX_RUN_PAGES)) {
+            pager_write_run(pager, run_start, iov, run_len);
+            run_len = 0;
+        }
+        if (!run_len) {
+            run_start = page_num;
+        }
+
+        iov[run_len].iov_base = pager->map + ((size_t)page_num * PAGE_SIZE);
+        iov[run_len].iov_len = PAGE_SIZE;
+        run_len++;
+
+        pager->dirty_map[page_num / 8] &= ~(1 << (page_num % 8));
+        pager->num_dirty--;
+    }
+
+    if (run_len) {
+        pager_write_run(pager, run_start, iov, run_len);
+    }
+}
+
+void mmap_close(pager_t* pager)
+{
+    munmap(pager->map, pager->map_reserved);
+    xfree(pager->dirty_map);
+    xfree(pager->verified_map);
+}
+
+void pager_flush(pager_t* pager, u64 page_num)
+{
+    frame_t* frame;
+    struct iovec iov;
+
+    frame = pager_find_frame(pager, page_num);
+    if (!frame) {
+        printf("tried to flush a page that's not in the buffer pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // with a log, a page evicted mid-statement is appended to it( uncommitted )
+    if (pager->wal) {
+        wal_queue_frame(pager->wal, page_num, frame->data);
+        wal_write_batch(pager->wal, 0);
+    } else {
+        iov.iov_base = frame->data, iov.iov_len = PAGE_SIZE;
+        pager_write_run(pager, page_num, &iov, 1);
+    }
+
+    if (frame->dirty) {
+        frame->dirty = false;
+        pager->num_dirty--;
+    }
+}
+
+/*
+    writes a run of consecutive pages, starting at "first_page_num", to disk
+    with a single vectored write
+*/
+void pager_write_run(pager_t* pager, u64 first_page_num, struct iovec* iov, u32 run_len)
+{
+    off_t end;
+    u32 i;
+
+    for (i = 0; i != run_len; ++i) {
+        page_set_checksum(iov[i].iov_base);
+    }
+
+    if (db_write_pages(pager->fd, first_page_num, iov, run_len,
+            pager->compress ? pager->slot_buf : NULL)
+        < 0) {
+        perror("error writing page cache to disk:");
+        exit(EXIT_FAILURE);
+    }
+
+    // pages evicted before they ever hit the disk grow the file
+    end = ((off_t)first_page_num + run_len) * PAGE_SIZE;
+    if (end > pager->file_len) {
+        pager->file_len = end;
+    }
+    if (pager->file_len > pager->alloc_len) {
+        pager->alloc_len = pager->file_len;
+    }
+}
+
+int compare_frame_page_nums(const void* a, const void* b)
+{
+    u64 page_a = (*(frame_t**)a)->page_num;
+    u64 page_b = (*(frame_t**)b)->page_num;
+
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+/*
+    writes back every page changed since it was read in. clean pages are
+    already identical to what's on disk so they're skipped.
+
+    dirty pages are sorted and pages next to each other on disk are written
+    together, so flushing a big working set costs one syscall per run of
+    pages instead of one per page
+*/
+void pager_checkpoint(pager_t* pager)
+{
+    struct iovec* iov;
+    frame_t** dirty;
+    u32 i, j, num_dirty, run_start, run_len;
+    uint64_t run;
+
+    if (pager->wal) {
+        if (pager_commit(pager) < 0 || wal_sync(pager->wal) < 0) {
+            printf("failed to sync the write-ahead log, %d.\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        return wal_checkpoint(pager);
+    }
+
+    pager_write_header(pager);
+    if (pager->mode == PAGER_MODE_MMAP) {
+        return mmap_checkpoint(pager);
+    }
+
+    dirty = pager->flush_list, iov = pager->flush_iov;
+    for (i = 0, num_dirty = 0; i != pager->num_frames; ++i) {
+        if (pager->frames[i].page_num != INVALID_PAGE_NUM && pager->frames[i].dirty) {
+            dirty[num_dirty++] = &pager->frames[i];
+        }
+    }
+
+    qsort(dirty, num_dirty, sizeof(frame_t*), compare_frame_page_nums);
+
+    for (run_start = 0, i = 1; i <= num_dirty; ++i) {
+        if (i != num_dirty && dirty[i]->page_num == dirty[i - 1]->page_num + 1
+            && i - run_start != MAX_RUN_PAGES) {
+            continue;
+        }
+
+        for (j = run_start; j != i; ++j) {
+            iov[j].iov_base = dirty[j]->data;
+            iov[j].iov_len = PAGE_SIZE;
+            dirty[j]->dirty = false;
+        }
+        run_len = i - run_start;
+        pager->num_dirty -= run_len;
+
+        // compressed pages are written one by one: each is packed into the one
+        // shared slot buffer and its slot's tail punched out before the next,
+        // so there's nothing to batch up for the ring
+        if (!pager->ring || pager->compress) {
+            pager_write_run(pager, dirty[run_start]->page_num, &iov[run_start], run_len);
+            run_start = i;
+            continue;
+        }
+
+        for (j = run_start; j != i; ++j) {
+            page_set_checksum(dirty[j]->data);
+        }
+
+        // with io_uring the whole dirty set goes to the kernel as one batch.
+        // the run is packed into the request's user_data, a run is at most
+        // MAX_RUN_PAGES long so 16 bits are plenty for its length
+        run = (dirty[run_start]->page_num << 16) | run_len;
+        if (uring_queue_writev(pager->ring, pager->fd, &iov[run_start], run_len,
+                (off_t)dirty[run_start]->page_num * PAGE_SIZE, run)
+            < 0) {
+            // submission queue is full, drain it first
+            pager_submit_writes(pager);
+            uring_queue_writev(pager->ring, pager->fd, &iov[run_start], run_len,
+                (off_t)dirty[run_start]->page_num * PAGE_SIZE, run);
+        }
+        run_start = i;
+    }
+
+    if (pager->ring && !pager->compress) {
+        pager_submit_writes(pager);
+    }
+}
+
+/*
+    writes a run of pages to their slots in the db file. "slot_buf" is NULL
+    unless compression is on, then every page that packs into fewer blocks than
+    a whole one is written on its own and the rest of its slot is punched out
+    of the file, the pages in between still go out together.
+
+    the file is always kept a whole number of pages long, a compressed last
+    page has its slot allocated to the end. returns -1 with errno set if a
+    write fails
+*/
+int db_write_pages(int fd, u64 first_page_num, struct iovec* iov, u32 run_len, void* slot_buf)
+{
+    struct stat st;
+    off_t offset, file_size;
+    u32 i, run_start, slot_len;
+
+    file_size = -1;
+    for (i = 0, run_start = 0; slot_buf && i != run_len; ++i) {
+        // the header is read before anything knows pages can be compressed
+        if (first_page_num + i == HEADER_PAGE_NUM) {
+            continue;
+        }
+        slot_len = page_compress(iov[i].iov_base, slot_buf);
+        if (!slot_len) {
+            continue;
+        }
+
+        offset = ((off_t)first_page_num + i) * PAGE_SIZE;
+        if (file_size < 0) {
+            if (fstat(fd, &st) < 0) {
+                return -1;
+            }
+            file_size = st.st_size;
+        }
+        // grow the file with fallocate() rather than ftruncate(), it can't
+        // shrink it if the file grew behind our back
+        if (offset + PAGE_SIZE > file_size) {
+            if (fallocate(fd, 0, offset + slot_len, PAGE_SIZE - slot_len) < 0) {
+                // can't grow the file past the slot, store the page whole
+                continue;
+            }
+            file_size = offset + PAGE_SIZE;
+        }
+        // no harm done if it can't be punched, nobody reads past the slot
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset + slot_len,
+            PAGE_SIZE - slot_len);
+
+        if (db_write_run(fd, first_page_num + run_start, &iov[run_start], i - run_start) < 0) {
+            return -1;
+        }
+        errno = 0;
+        if (pwrite(fd, slot_buf, slot_len, offset) != slot_len) {
+            errno = errno ? errno : EIO;
+            return -1;
+        }
+        run_start = i + 1;
+    }
+
+    return db_write_run(fd, first_page_num + run_start, &iov[run_start], run_len - run_start);
 }
 
-void pager_flush(pager_t* pager, u32 page_num)
+// writes pages that sit next to each other in the db file with one syscall
+int db_write_run(int fd, u64 first_page_num, struct iovec* iov, u32 run_len)
 {
-    off_t offset;
     ssize_t bytes_written;
 
-    if (!pager->pages[page_num]) {
-        printf("tried to flush null page\n");
-        exit(EXIT_FAILURE);
-    }
+    if (!run_len) {
+        return 0;
+    }
+
+    errno = 0;
+    bytes_written = pwritev(fd, iov, run_len, (off_t)first_page_num * PAGE_SIZE);
+    if (bytes_written != (ssize_t)run_len * PAGE_SIZE) {
+        // a short write leaves errno alone
+        errno = errno ? errno : EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+    packs a page into "slot": a slot_header_t, the compressed page and zeros
+    up to the next block. returns the slot's length, or 0 if that doesn't save
+    at least one block
+*/
+u32 page_compress(void* page, void* slot)
+{
+    slot_header_t* header = slot;
+    size_t len;
+    u32 slot_len;
+
+    if (PAGE_SIZE <= SLOT_BLOCK_SIZE) {
+        return 0;
+    }
+
+    len = lz_compress(page, PAGE_SIZE, slot + sizeof(slot_header_t),
+        PAGE_SIZE - SLOT_BLOCK_SIZE - sizeof(slot_header_t));
+    if (!len) {
+        return 0;
+    }
+
+    header->magic = SLOT_MAGIC;
+    header->len = len;
+    slot_len = (sizeof(slot_header_t) + len + SLOT_BLOCK_SIZE - 1) & ~(SLOT_BLOCK_SIZE - 1);
+    memset(slot + sizeof(slot_header_t) + len, 0x0, slot_len - sizeof(slot_header_t) - len);
+
+    return slot_len;
+}
+
+/*
+    turns a page read from its slot in the db file back into the page, if it
+    was stored compressed. "scratch" has to hold a page. false if it doesn't
+    decompress to exactly one page
+*/
+bool page_inflate(void* page, void* scratch)
+{
+    slot_header_t header;
+
+    memcpy(&header, page, sizeof(header));
+    if (header.magic != SLOT_MAGIC) {
+        return true;
+    }
+
+    if (header.len > PAGE_SIZE - sizeof(header)
+        || lz_decompress(page + sizeof(header), header.len, scratch, PAGE_SIZE) != PAGE_SIZE) {
+        return false;
+    }
+    memcpy(page, scratch, PAGE_SIZE);
+
+    return true;
+}
+
+// only a db file that was ever written with compression on has compressed pages
+void pager_inflate(pager_t* pager, u64 page_num, void* page)
+{
+    if (!(pager->header.flags & DB_FLAG_COMPRESSED)) {
+        return;
+    }
+
+    if (!page_inflate(page, pager->slot_buf)) {
+        printf("page %llu failed to decompress. Corrupt database file.\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    ends a statement: every page it changed is appended to the log, with the
+    last one marked as the commit, then it's synced as far as the sync mode
+    asks for( see pager_sync() ). in full sync mode that means the statement
+    is on disk before it's acknowledged.
+
+    without a log there's nothing to do, pages reach the db file when they're
+    evicted or at checkpoint. returns -1 if the log couldn't be synced, with
+    errno set
+*/
+int pager_commit(pager_t* pager)
+{
+    wal_t* wal = pager->wal;
+    u64 i;
+
+    if (!wal) {
+        return 0;
+    }
+
+    pager_write_header(pager);
+    if (!pager->num_dirty) {
+        if (wal->num_frames == wal->committed_frames) {
+            return 0;
+        }
+
+        // everything the statement changed got evicted( and logged ) on the
+        // way, the commit still needs a frame to ride on
+        get_page(pager, HEADER_PAGE_NUM);
+        pager_mark_dirty(pager, HEADER_PAGE_NUM);
+    }
+
+    wal_try_restart(pager);
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        for (i = 0; i < pager->num_pages; ++i) {
+            if (!pager->dirty_map[i / 8]) {
+                i |= 7;
+                continue;
+            }
+            if (pager->dirty_map[i / 8] & (1 << (i % 8))) {
+                wal_queue_frame(wal, i, pager->map + ((size_t)i * PAGE_SIZE));
+            }
+        }
+        memset(pager->dirty_map, 0x0, pager->dirty_map_len);
+    } else {
+        for (i = 0; i != pager->num_frames; ++i) {
+            if (pager->frames[i].page_num != INVALID_PAGE_NUM && pager->frames[i].dirty) {
+                wal_queue_frame(wal, pager->frames[i].page_num, pager->frames[i].data);
+                pager->frames[i].dirty = false;
+            }
+        }
+    }
+
+    wal_write_batch(wal, pager->num_pages);
+    wal->committed_frames = wal->num_frames;
+    pager->num_dirty = 0;
+
+    return pager_sync(pager);
+}
+
+/*
+    makes every commit so far durable with an fsync of the log, then kicks off
+    a checkpoint if the log has grown big enough. full mode syncs every time,
+    normal mode only ahead of a checkpoint and off mode never. returns -1 if
+    the fsync failed, with errno set
+*/
+int pager_sync(pager_t* pager)
+{
+    wal_t* wal = pager->wal;
+    bool checkpoint_due;
+
+    if (!wal || wal->synced_frames == wal->committed_frames) {
+        return 0;
+    }
+
+    // in normal mode the log only has to be on disk before the checkpointer
+    // copies it into the db file, a torn log can't be allowed to take a half
+    // copied commit with it
+    checkpoint_due = wal->num_frames >= WAL_MAX_FRAMES
+        || wal->num_frames - wal->backfilled >= WAL_CHECKPOINT_FRAMES;
+    if (pager->sync_mode == SYNC_MODE_NORMAL && !checkpoint_due) {
+        return 0;
+    }
+
+    if (wal_sync(wal) < 0) {
+        return -1;
+    }
+
+    // the checkpointer can't keep up, wait for it rather than let the log
+    // grow without bound
+    if (wal->num_frames >= WAL_MAX_FRAMES) {
+        wal_checkpoint(pager);
+    } else if (wal->num_frames - wal->backfilled >= WAL_CHECKPOINT_FRAMES) {
+        wal_start_checkpoint(wal);
+    }
+    return 0;
+}
+
+/*
+    switches the sync mode, see sync_mode_t. commits normal or off mode left
+    unsynced get synced now if the new mode is full. returns -1 if that sync
+    failed, with errno set
+*/
+int pager_set_sync_mode(pager_t* pager, sync_mode_t mode)
+{
+    pager->sync_mode = mode;
+    if (pager->wal) {
+        pthread_mutex_lock(&pager->wal->lock);
+        pager->wal->sync_mode = mode;
+        pthread_mutex_unlock(&pager->wal->lock);
+    }
+
+    return mode == SYNC_MODE_FULL ? pager_sync(pager) : 0;
+}
+
+int parse_sync_mode(const char* name, sync_mode_t* mode)
+{
+    if (str_exactly_equal(name, "off")) {
+        *mode = SYNC_MODE_OFF;
+    } else if (str_exactly_equal(name, "normal")) {
+        *mode = SYNC_MODE_NORMAL;
+    } else if (str_exactly_equal(name, "full")) {
+        *mode = SYNC_MODE_FULL;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+const char* sync_mode_name(sync_mode_t mode)
+{
+    switch (mode) {
+    case SYNC_MODE_OFF:
+        return "off";
+    case SYNC_MODE_NORMAL:
+        return "normal";
+    default:
+        return "full";
+    }
+}
+
+void pager_submit_writes(pager_t* pager)
+{
+    if (uring_submit_and_wait(pager->ring, pager_write_done, pager) < 0) {
+        printf("failed to submit page writes, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void pager_close(pager_t* pager)
+{
+    int result;
+
+    // a backup that's still going is finished before the db goes away
+    while (pager->backup && !pager_backup_step(pager, BACKUP_STEP_PAGES)) { }
+
+    pager_save_warm_set(pager);
+    pager_checkpoint(pager);
+
+    if (pager->wal) {
+        wal_close(pager);
+    }
+    if (pager->mode == PAGER_MODE_MMAP) {
+        mmap_close(pager);
+    }
+    if (pager->ring) {
+        uring_close(pager->ring);
+        xfree(pager->ring);
+    }
+    pager_trim(pager);
+
+    // without a log this is the only time the db file is made durable
+    if (pager->sync_mode != SYNC_MODE_OFF && fdatasync(pager->fd) < 0) {
+        printf("failed to sync the db file, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    result = close(pager->fd);
+    if (result < 0) {
+        printf("error closing database.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    free_mem(pager->arena);
+    free_mem(pager->slot_buf);
+    xfree(pager->frames);
+    xfree(pager->buckets);
+    xfree(pager->flush_list);
+    xfree(pager->flush_iov);
+    xfree(pager->warm_path);
+    xfree(pager);
+}
+
+// W R I T E - A H E A D  L O G
+/*
+    opens "<db file>-wal", replays whatever a previous session committed but
+    never checkpointed and starts the background checkpointer
+*/
+int wal_open(pager_t* pager, const char* db_fname)
+{
+    wal_t* wal;
+    u32 i;
+
+    wal = xmalloc(sizeof(wal_t));
+    wal->path = xmalloc(strlen(db_fname) + sizeof("-wal"));
+    sprintf(wal->path, "%s-wal", db_fname);
+
+    wal->fd = open(wal->path, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    if (wal->fd < 0) {
+        xfree(wal->path);
+        xfree(wal);
+        return -1;
+    }
+
+    wal->db_fd = pager->fd;
+    wal->sync_mode = pager->sync_mode;
+    wal->index_capacity = 1024, wal->index_count = 0;
+    wal->index = xmalloc(wal->index_capacity * sizeof(wal_entry_t));
+    for (i = 0; i != wal->index_capacity; ++i) {
+        wal->index[i].page_num = INVALID_PAGE_NUM;
+    }
+
+    wal->batch_headers = xmalloc(WAL_BATCH_FRAMES * sizeof(wal_frame_header_t));
+    wal->batch_iov = xmalloc(2 * WAL_BATCH_FRAMES * sizeof(struct iovec));
+    wal->batch_len = 0;
+
+    wal->snapshot = NULL;
+    wal->snapshot_len = 0, wal->snapshot_capacity = 0;
+    wal->checkpoint_requested = false, wal->stop = false;
+
+    wal_recover(wal);
+    wal->backfill_buf = xmemalign(PAGE_SIZE, (size_t)WAL_BACKFILL_RUN * PAGE_SIZE);
+    wal->slot_buf = pager->compress ? xmemalign(PAGE_SIZE, PAGE_SIZE) : NULL;
+
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->cond, NULL);
+    if (pthread_create(&wal->checkpointer, NULL, wal_checkpointer, wal) != 0) {
+        printf("unable to start the checkpointer thread.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pager->wal = wal;
+
+    return 0;
+}
+
+/*
+    copies every committed frame left in the log into the db file. frames are
+    only trusted up to the last commit frame whose salt and checksum check
+    out, anything after that belongs to a statement that never finished
+*/
+void wal_recover(wal_t* wal)
+{
+    wal_header_t header;
+    wal_frame_header_t frame_header;
+    void* page;
+    u32 n, num_committed;
+    ssize_t bytes_read;
+
+    bytes_read = pread(wal->fd, &header, sizeof(header), 0);
+    if (bytes_read != sizeof(header) || header.magic != WAL_MAGIC
+        || header.version != WAL_VERSION) {
+        wal_restart(wal, (u32)time(NULL) ^ (u32)getpid());
+        return;
+    }
+    if (header.page_size != PAGE_SIZE) {
+        // a brand new db can crash before its first checkpoint, all it has
+        // then is the log
+        if (lseek(wal->db_fd, 0, SEEK_END) != 0 || !is_valid_page_size(header.page_size)) {
+            printf("write-ahead log page size doesn't match the db. Corrupt wal file.\n");
+            exit(EXIT_FAILURE);
+        }
+        set_page_size(header.page_size);
+    }
+
+    page = xmalloc(PAGE_SIZE);
+    wal->salt = header.salt;
+
+    // find the last commit
+    for (n = 0, num_committed = 0;; ++n) {
+        bytes_read = pread(wal->fd, &frame_header, sizeof(frame_header), wal_frame_offset(n));
+        if (bytes_read != sizeof(frame_header) || frame_header.salt != wal->salt) {
+            break;
+        }
+
+        bytes_read = pread(wal->fd, page, PAGE_SIZE,
+            wal_frame_offset(n) + sizeof(wal_frame_header_t));
+        if (bytes_read != PAGE_SIZE
+            || wal_checksum(page, PAGE_SIZE,
+                   wal_checksum(&frame_header, offsetof(wal_frame_header_t, checksum), 0))
+                != frame_header.checksum) {
+            break;
+        }
+
+        if (frame_header.db_size) {
+            num_committed = n + 1;
+        }
+    }
+
+    // replay in log order so the latest image of every page wins
+    for (n = 0; n != num_committed; ++n) {
+        pread(wal->fd, &frame_header, sizeof(frame_header), wal_frame_offset(n));
+        wal_read_page(wal, n, page);
+
+        if (pwrite(wal->db_fd, page, PAGE_SIZE, (off_t)frame_header.page_num * PAGE_SIZE)
+            != PAGE_SIZE) {
+            printf("failed to replay the write-ahead log, %d.\n", errno);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_committed && fdatasync(wal->db_fd) < 0) {
+        printf("failed to sync the db file, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    xfree(page);
+    wal_restart(wal, wal->salt + 1);
+}
+
+/*
+    empties the log. a new salt tells the frames of the previous round apart
+    from the ones about to be written over them
+*/
+void wal_restart(wal_t* wal, u32 salt)
+{
+    wal_header_t header;
+    u32 i;
+
+    header.magic = WAL_MAGIC, header.version = WAL_VERSION;
+    header.page_size = PAGE_SIZE, header.salt = salt;
+    if (pwrite(wal->fd, &header, sizeof(header), 0) != sizeof(header)) {
+        printf("failed to write the write-ahead log header, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    wal->salt = salt;
+    wal->num_frames = 0, wal->committed_frames = 0, wal->synced_frames = 0;
+    wal->checkpoint_upto = 0, wal->backfilled = 0, wal->backfill_end = 0;
+
+    for (i = 0; i != wal->index_capacity; ++i) {
+        wal->index[i].page_num = INVALID_PAGE_NUM;
+    }
+    wal->index_count = 0;
+}
+
+// fletcher-style checksum over 32-bit words, "len" must be a multiple of 4
+u32 wal_checksum(const void* data, size_t len, u32 seed)
+{
+    const u32* words = data;
+    u32 s1, s2;
+    size_t i;
+
+    s1 = seed, s2 = seed >> 16;
+    for (i = 0; i != len / sizeof(u32); ++i) {
+        s1 += words[i] + s2;
+        s2 += words[i] + s1;
+    }
+
+    return s1 ^ (s2 << 16 | s2 >> 16);
+}
+
+off_t wal_frame_offset(u32 frame_num)
+{
+    return sizeof(wal_header_t)
+        + (off_t)frame_num * (sizeof(wal_frame_header_t) + PAGE_SIZE);
+}
+
+u32 wal_index_lookup(wal_t* wal, u64 page_num)
+{
+    u32 i, mask;
+
+    mask = wal->index_capacity - 1;
+    for (i = page_num & mask; wal->index[i].page_num != INVALID_PAGE_NUM;
+         i = (i + 1) & mask) {
+        if (wal->index[i].page_num == page_num) {
+            return wal->index[i].frame_num;
+        }
+    }
+
+    return WAL_NO_FRAME;
+}
+
+void wal_index_set(wal_t* wal, u64 page_num, u32 frame_num)
+{
+    wal_entry_t* old_index;
+    u32 i, mask, old_capacity;
+
+    // keep the table at most half full so probe sequences stay short
+    if ((wal->index_count + 1) * 2 > wal->index_capacity) {
+        old_index = wal->index, old_capacity = wal->index_capacity;
+
+        wal->index_capacity *= 2, wal->index_count = 0;
+        wal->index = xmalloc(wal->index_capacity * sizeof(wal_entry_t));
+        for (i = 0; i != wal->index_capacity; ++i) {
+            wal->index[i].page_num = INVALID_PAGE_NUM;
+        }
+        for (i = 0; i != old_capacity; ++i) {
+            if (old_index[i].page_num != INVALID_PAGE_NUM) {
+                wal_index_set(wal, old_index[i].page_num, old_index[i].frame_num);
+            }
+        }
+
+        xfree(old_index);
+    }
+
+    mask = wal->index_capacity - 1;
+    for (i = page_num & mask; wal->index[i].page_num != INVALID_PAGE_NUM;
+         i = (i + 1) & mask) {
+        if (wal->index[i].page_num == page_num) {
+            wal->index[i].frame_num = frame_num;
+            return;
+        }
+    }
+
+    wal->index[i].page_num = page_num, wal->index[i].frame_num = frame_num;
+    wal->index_count++;
+}
+
+void wal_read_page(wal_t* wal, u32 frame_num, void* dest)
+{
+    ssize_t bytes_read;
+
+    bytes_read = pread(
+        wal->fd, dest, PAGE_SIZE, wal_frame_offset(frame_num) + sizeof(wal_frame_header_t));
+    if (bytes_read != PAGE_SIZE) {
+        printf("failed to read page from the write-ahead log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    adds a page image to the batch being appended to the log. the page must
+    stay put until the batch is written
+*/
+void wal_queue_frame(wal_t* wal, u64 page_num, void* data)
+{
+    wal_frame_header_t* header;
+
+    if (wal->batch_len == WAL_BATCH_FRAMES) {
+        wal_write_batch(wal, 0);
+    }
+
+    // the log's frame checksum only covers the trip thru the log, the page
+    // carries its own into the db file
+    page_set_checksum(data);
+
+    header = &wal->batch_headers[wal->batch_len];
+    header->page_num = page_num;
+    header->db_size = 0;
+    header->salt = wal->salt;
+
+    wal->batch_iov[2 * wal->batch_len].iov_base = header;
+    wal->batch_iov[2 * wal->batch_len].iov_len = sizeof(wal_frame_header_t);
+    wal->batch_iov[2 * wal->batch_len + 1].iov_base = data;
+    wal->batch_iov[2 * wal->batch_len + 1].iov_len = PAGE_SIZE;
+
+    wal_index_set(wal, page_num, wal->num_frames + wal->batch_len);
+    wal->batch_len++;
+}
+
+/*
+    appends the queued frames to the log with a single vectored write. a
+    non-zero "db_size" turns the last frame into a commit frame
+*/
+void wal_write_batch(wal_t* wal, u64 db_size)
+{
+    wal_frame_header_t* header;
+    ssize_t bytes_written, expected;
+    u32 i;
+
+    if (!wal->batch_len) {
+        return;
+    }
+
+    wal->batch_headers[wal->batch_len - 1].db_size = db_size;
+    for (i = 0; i != wal->batch_len; ++i) {
+        header = &wal->batch_headers[i];
+        header->checksum = wal_checksum(wal->batch_iov[2 * i + 1].iov_base, PAGE_SIZE,
+            wal_checksum(header, offsetof(wal_frame_header_t, checksum), 0));
+    }
+
+    expected = (ssize_t)wal->batch_len * (sizeof(wal_frame_header_t) + PAGE_SIZE);
+    bytes_written = pwritev(
+        wal->fd, wal->batch_iov, 2 * wal->batch_len, wal_frame_offset(wal->num_frames));
+    if (bytes_written != expected) {
+        printf("failed to append to the write-ahead log, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    // get write-back going now so the fsync that ends the commit has less left
+    // to wait for
+    if (wal->sync_mode != SYNC_MODE_OFF) {
+        sync_file_range(wal->fd, wal_frame_offset(wal->num_frames), expected,
+            SYNC_FILE_RANGE_WRITE);
+    }
+
+    wal->num_frames += wal->batch_len;
+    wal->batch_len = 0;
+}
+
+// hands every commit so far to the checkpointer, fsyncing them first unless
+// syncing is off. returns -1 if the fsync failed, with errno set
+int wal_sync(wal_t* wal)
+{
+    if (wal->synced_frames == wal->committed_frames) {
+        return 0;
+    }
+
+    if (wal->sync_mode != SYNC_MODE_OFF && fdatasync(wal->fd) < 0) {
+        return -1;
+    }
+    wal->synced_frames = wal->committed_frames;
+    return 0;
+}
+
+/*
+    hands every synced frame to the checkpointer thread, unless it's still
+    busy with the previous round. the thread gets its own copy of the index
+    since the log keeps growing while it works
+*/
+void wal_start_checkpoint(wal_t* wal)
+{
+    u32 i;
+
+    pthread_mutex_lock(&wal->lock);
+    if (wal->checkpoint_requested) {
+        pthread_mutex_unlock(&wal->lock);
+        return;
+    }
+
+    if (wal->snapshot_capacity < wal->index_count) {
+        xfree(wal->snapshot);
+        wal->snapshot_capacity = wal->index_capacity;
+        wal->snapshot = xmalloc(wal->snapshot_capacity * sizeof(wal_entry_t));
+    }
+
+    wal->snapshot_len = 0;
+    for (i = 0; i != wal->index_capacity; ++i) {
+        if (wal->index[i].page_num != INVALID_PAGE_NUM
+            && wal->index[i].frame_num < wal->synced_frames) {
+            wal->snapshot[wal->snapshot_len++] = wal->index[i];
+        }
+    }
+
+    wal->checkpoint_upto = wal->synced_frames;
+    wal->checkpoint_requested = true;
+    pthread_cond_broadcast(&wal->cond);
+    pthread_mutex_unlock(&wal->lock);
+}
+
+void wal_wait_checkpoint(wal_t* wal)
+{
+    pthread_mutex_lock(&wal->lock);
+    while (wal->checkpoint_requested) {
+        pthread_cond_wait(&wal->cond, &wal->lock);
+    }
+    pthread_mutex_unlock(&wal->lock);
+}
+
+/*
+    copies the whole log into the db file and waits for it, then empties the
+    log. only called when every frame in it is committed and synced
+*/
+void wal_checkpoint(pager_t* pager)
+{
+    wal_t* wal = pager->wal;
+
+    wal_wait_checkpoint(wal);
+    if (wal->backfilled != wal->num_frames) {
+        wal_start_checkpoint(wal);
+        wal_wait_checkpoint(wal);
+    }
+
+    wal_try_restart(pager);
+}
+
+/*
+    starts the log over once the checkpointer has copied all of it. pages it
+    wrote past the old end of the db file are readable from there from now on
+*/
+void wal_try_restart(pager_t* pager)
+{
+    wal_t* wal = pager->wal;
+    off_t end;
+    bool done;
+
+    pthread_mutex_lock(&wal->lock);
+    done = !wal->checkpoint_requested && wal->num_frames
+        && wal->backfilled == wal->num_frames;
+    end = wal->backfill_end;
+    pthread_mutex_unlock(&wal->lock);
+
+    if (!done) {
+        return;
+    }
+
+    if (end > pager->file_len) {
+        pager->file_len = end;
+    }
+    if (pager->file_len > pager->alloc_len) {
+        pager->alloc_len = pager->file_len;
+    }
+    wal_restart(wal, wal->salt + 1);
+}
+
+void* wal_checkpointer(void* arg)
+{
+    wal_t* wal = arg;
+    off_t end;
+    bool sync;
+
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        while (!wal->checkpoint_requested && !wal->stop) {
+            pthread_cond_wait(&wal->cond, &wal->lock);
+        }
+        if (!wal->checkpoint_requested) {
+            break;
+        }
+
+        sync = wal->sync_mode != SYNC_MODE_OFF;
+        pthread_mutex_unlock(&wal->lock);
+        end = wal_backfill(wal, sync);
+        pthread_mutex_lock(&wal->lock);
+
+        wal->backfilled = wal->checkpoint_upto;
+        if (end > wal->backfill_end) {
+            wal->backfill_end = end;
+        }
+        wal->checkpoint_requested = false;
+        pthread_cond_broadcast(&wal->cond);
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    return NULL;
+}
+
+/*
+    runs on the checkpointer thread. writes the latest logged image of every
+    page in the snapshot into the db file, in page order so that neighbouring
+    pages go out with one write, and syncs it. returns the end of the furthest
+    page written.
+
+    the main thread never reads a logged page from the db file, so the two
+    don't step on each other
+*/
+off_t wal_backfill(wal_t* wal, bool sync)
+{
+    struct iovec iov[WAL_BACKFILL_RUN];
+    void* buf = wal->backfill_buf;
+    u32 i, run_start, run_len;
+    off_t end;
+
+    qsort(wal->snapshot, wal->snapshot_len, sizeof(wal_entry_t), compare_wal_entries);
+
+    for (i = 0, run_len = 0, end = 0; i != wal->snapshot_len; ++i) {
+        if (!run_len) {
+            run_start = i;
+        }
+
+        iov[run_len].iov_base = buf + (size_t)run_len * PAGE_SIZE;
+        iov[run_len].iov_len = PAGE_SIZE;
+        wal_read_page(wal, wal->snapshot[i].frame_num, iov[run_len].iov_base);
+        run_len++;
+
+        if (i + 1 != wal->snapshot_len && run_len != WAL_BACKFILL_RUN
+            && wal->snapshot[i + 1].page_num == wal->snapshot[i].page_num + 1) {
+            continue;
+        }
+
+        if (db_write_pages(wal->db_fd, wal->snapshot[run_start].page_num, iov, run_len,
+                wal->slot_buf)
+            < 0) {
+            printf("failed to checkpoint the write-ahead log, %d.\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        if (sync) {
+            sync_file_range(wal->db_fd, (off_t)wal->snapshot[run_start].page_num * PAGE_SIZE,
+                (off_t)run_len * PAGE_SIZE, SYNC_FILE_RANGE_WRITE);
+        }
+        end = ((off_t)wal->snapshot[i].page_num + 1) * PAGE_SIZE;
+        run_len = 0;
+    }
+
+    if (sync && wal->snapshot_len && fdatasync(wal->db_fd) < 0) {
+        printf("failed to sync the db file, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    return end;
+}
+
+int compare_wal_entries(const void* a, const void* b)
+{
+    u64 page_a = ((wal_entry_t*)a)->page_num;
+    u64 page_b = ((wal_entry_t*)b)->page_num;
+
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+// stops the checkpointer and deletes the log, which must be empty by now
+void wal_close(pager_t* pager)
+{
+    wal_t* wal = pager->wal;
+
+    pthread_mutex_lock(&wal->lock);
+    wal->stop = true;
+    pthread_cond_broadcast(&wal->cond);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->checkpointer, NULL);
+
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->cond);
+
+    close(wal->fd);
+    if (unlink(wal->path) < 0) {
+        printf("failed to remove the write-ahead log, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    xfree(wal->snapshot);
+    free_mem(wal->backfill_buf);
+    if (wal->slot_buf) {
+        free_mem(wal->slot_buf);
+    }
+    xfree(wal->batch_iov);
+    xfree(wal->batch_headers);
+    xfree(wal->index);
+    xfree(wal->path);
+    xfree(wal);
+    pager->wal = NULL;
+}
+
+// C H E C K S U M S
+
+/*
+    stamps the page with a crc32c of everything before its trailer. done on
+    the way out to disk, so the b-tree never has to care
+*/
+void page_set_checksum(void* page)
+{
+    u32 crc = crc32c(page, PAGE_SIZE - PAGE_TRAILER_SIZE);
+
+    memcpy(page + PAGE_SIZE - PAGE_TRAILER_SIZE, &crc, PAGE_TRAILER_SIZE);
+}
+
+bool page_checksum_ok(void* page)
+{
+    u32 crc, stored;
+
+    crc = crc32c(page, PAGE_SIZE - PAGE_TRAILER_SIZE);
+    memcpy(&stored, page + PAGE_SIZE - PAGE_TRAILER_SIZE, PAGE_TRAILER_SIZE);
+    if (crc == stored) {
+        return true;
+    }
+
+    // a page that was never written out( a hole, or past the end of file )
+    // is all zeros, trailer included
+    return page_is_zeroed(page);
+}
+
+// a page that doesn't match its checksum is never handed to the b-tree
+void verify_page(u64 page_num, void* page)
+{
+    if (!page_checksum_ok(page)) {
+        printf("page %llu failed its checksum. Corrupt database file.\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void pager_verify_frame(frame_t* frame)
+{
+    verify_page(frame->page_num, frame->data);
+    frame->unverified = false;
+}
+
+/*
+    ".check" reads every page back from disk, whatever the verify mode, and
+    reports the ones that don't match their checksum. pages changed since the
+    last checkpoint are read from the log, pages that never left the buffer
+    pool have nothing on disk to check yet. returns how many are corrupt
+*/
+u64 pager_check(pager_t* pager)
+{
+    u64 page_num, on_disk, checked, corrupt;
+    ssize_t bytes_read;
+    u32 frame_num;
+    void* page;
+
+    // aligned, the db file may be open with O_DIRECT
+    page = xmemalign(PAGE_SIZE, PAGE_SIZE);
+    on_disk = pager->file_len / PAGE_SIZE;
+    checked = 0, corrupt = 0;
+    for (page_num = 0; page_num != pager->num_pages; ++page_num) {
+        if (pager->wal
+            && (frame_num = wal_index_lookup(pager->wal, page_num)) != WAL_NO_FRAME) {
+            wal_read_page(pager->wal, frame_num, page);
+        } else if (page_num < on_disk) {
+            bytes_read = pread(pager->fd, page, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
+            if (bytes_read < 0) {
+                printf("failed to read in data from file: %d\n", errno);
+                exit(EXIT_FAILURE);
+            }
+            memset(page + bytes_read, 0x0, PAGE_SIZE - bytes_read);
+        } else {
+            continue;
+        }
+
+        checked++;
+        if ((pager->header.flags & DB_FLAG_COMPRESSED) && !page_inflate(page, pager->slot_buf)) {
+            printf("page %llu: doesn't decompress\n", page_num);
+            corrupt++;
+        } else if (!page_checksum_ok(page)) {
+            printf("page %llu: bad checksum\n", page_num);
+            corrupt++;
+        }
+    }
+    free_mem(page);
+
+    printf("pages checked: %llu, corrupt: %llu\n", checked, corrupt);
+    return corrupt;
+}
+
+int parse_verify_mode(const char* name, verify_mode_t* mode)
+{
+    if (str_exactly_equal(name, "read")) {
+        *mode = VERIFY_MODE_READ;
+    } else if (str_exactly_equal(name, "lazy")) {
+        *mode = VERIFY_MODE_LAZY;
+    } else if (str_exactly_equal(name, "check")) {
+        *mode = VERIFY_MODE_CHECK;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+// O N L I N E  B A C K U P
+/*
+    starts copying the db into "path". nothing's copied yet, that happens a
+    step at a time in pager_backup_step()
+*/
+int pager_backup_start(pager_t* pager, const char* path)
+{
+    backup_t* b;
+    int fd;
+
+    b = xmalloc(sizeof(backup_t));
+    b->tmp_path = xmalloc(strlen(path) + sizeof("-tmp"));
+    sprintf(b->tmp_path, "%s-tmp", path);
+
+    fd = open(b->tmp_path, O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (fd < 0) {
+        xfree(b->tmp_path);
+        xfree(b);
+        return -1;
+    }
+
+    b->fd = fd;
+    b->path = (char*)xstrdup(path);
+    b->next_page = 1; // the header goes last
+    b->changed = NULL, b->changed_len = 0;
+    b->num_changed = 0, b->first_changed = 0;
+    b->pages_copied = 0;
+    b->buf = xmemalign(PAGE_SIZE, PAGE_SIZE);
+    pager->backup = b;
+
+    return 0;
+}
+
+/*
+    copies up to "max_pages" pages, the ones that changed since they were
+    copied first. returns 1 once the backup is complete, 0 if there's more to
+    copy and -1 if it failed, either way it's over unless 0 is returned
+*/
+int pager_backup_step(pager_t* pager, u32 max_pages)
+{
+    backup_t* b = pager->backup;
+    u64 page_num;
+    u32 copied;
+
+    copied = 0;
+    for (page_num = b->first_changed; b->num_changed && copied != max_pages; ++page_num) {
+        if (!b->changed[page_num / 8]) {
+            page_num |= 7;
+            continue;
+        }
+        if (!(b->changed[page_num / 8] & (1 << (page_num % 8)))) {
+            continue;
+        }
+
+        b->changed[page_num / 8] &= ~(1 << (page_num % 8));
+        b->num_changed--;
+        if (pager_backup_write_page(pager, page_num) < 0) {
+            return -1;
+        }
+        copied++;
+    }
+    b->first_changed = page_num;
+
+    for (; b->next_page < pager->num_pages && copied != max_pages; ++copied) {
+        if (pager_backup_write_page(pager, b->next_page++) < 0) {
+            return -1;
+        }
+    }
+
+    if (b->next_page < pager->num_pages || b->num_changed) {
+        return 0;
+    }
+
+    return pager_backup_finish(pager) < 0 ? -1 : 1;
+}
+
+// flags a page that was copied already, it has to go again
+void pager_backup_changed(pager_t* pager, u64 page_num)
+{
+    backup_t* b = pager->backup;
+    size_t len;
+
+    if (page_num == HEADER_PAGE_NUM || page_num >= b->next_page
+        || (page_num / 8 < b->changed_len && (b->changed[page_num / 8] & (1 << (page_num % 8))))) {
+        return;
+    }
+
+    if (page_num / 8 >= b->changed_len) {
+        len = b->changed_len;
+        b->changed_len = (b->next_page + 7) / 8;
+        b->changed = xrealloc(b->changed, b->changed_len);
+        memset(b->changed + len, 0x0, b->changed_len - len);
+    }
+
+    if (!b->num_changed || page_num < b->first_changed) {
+        b->first_changed = page_num;
+    }
+    b->changed[page_num / 8] |= 1 << (page_num % 8);
+    b->num_changed++;
+}
+
+/*
+    gets the latest copy of a page without pulling it into the buffer pool,
+    a backup reads every page once and would only push the hot ones out.
+    between statements the pool and the log hold the same committed pages
+*/
+void pager_backup_read_page(pager_t* pager, u64 page_num, void* page)
+{
+    ssize_t bytes_read;
+    frame_t* frame;
+    u32 frame_num;
+
+    if (pager->mode == PAGER_MODE_MMAP) {
+        memcpy(page, pager->map + ((size_t)page_num * PAGE_SIZE), PAGE_SIZE);
+        return;
+    }
+
+    if ((frame = pager_find_frame(pager, page_num))) {
+        memcpy(page, frame->data, PAGE_SIZE);
+    } else if (pager->wal
+        && (frame_num = wal_index_lookup(pager->wal, page_num)) != WAL_NO_FRAME) {
+        wal_read_page(pager->wal, frame_num, page);
+    } else if ((off_t)page_num * PAGE_SIZE < pager->file_len) {
+        bytes_read = pread(pager->fd, page, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
+        if (bytes_read < 0) {
+            printf("failed to read in data from file: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        memset(page + bytes_read, 0x0, PAGE_SIZE - bytes_read);
+        pager_inflate(pager, page_num, page);
+    } else {
+        memset(page, 0x0, PAGE_SIZE);
+    }
+}
+
+// pages are copied out whole, the backup is never compressed
+int pager_backup_write_page(pager_t* pager, u64 page_num)
+{
+    backup_t* b = pager->backup;
+
+    pager_backup_read_page(pager, page_num, b->buf);
+    page_set_checksum(b->buf);
+    if (pwrite(b->fd, b->buf, PAGE_SIZE, (off_t)page_num * PAGE_SIZE) != PAGE_SIZE) {
+        printf("backup to '%s' failed writing page %llu, %d.\n", b->path, page_num, errno);
+        pager_backup_end(pager);
+        return -1;
+    }
+    b->pages_copied++;
+
+    return 0;
+}
+
+/*
+    writes the header, syncs the copy and renames it into place. it's only
+    there under its own name once it's complete
+*/
+int pager_backup_finish(pager_t* pager)
+{
+    backup_t* b = pager->backup;
+    db_header_t* header;
+
+    memset(b->buf, 0x0, PAGE_SIZE);
+    header = b->buf;
+    memcpy(header, &pager->header, sizeof(db_header_t));
+    header->num_pages = pager->num_pages;
+    header->flags &= ~DB_FLAG_COMPRESSED;
+    page_set_checksum(b->buf);
+
+    if (pwrite(b->fd, b->buf, PAGE_SIZE, 0) != PAGE_SIZE
+        || (pager->sync_mode != SYNC_MODE_OFF && fdatasync(b->fd) < 0)
+        || rename(b->tmp_path, b->path) < 0
+        || (pager->sync_mode != SYNC_MODE_OFF && sync_parent_dir(b->path) < 0)) {
+        printf("backup to '%s' failed, %d.\n", b->path, errno);
+        pager_backup_end(pager);
+        return -1;
+    }
+
+    printf("backed up %llu pages to '%s'.\n", pager->num_pages, b->path);
+    pager_backup_end(pager);
+    return 0;
+}
+
+// drops the backup, whatever's left of an unfinished one is removed
+void pager_backup_end(pager_t* pager)
+{
+    backup_t* b = pager->backup;
+
+    close(b->fd);
+    unlink(b->tmp_path);
+
+    free_mem(b->buf);
+    xfree(b->changed);
+    xfree(b->path);
+    xfree(b->tmp_path);
+    xfree(b);
+    pager->backup = NULL;
+}
+
+// W A R M  S T A R T
+/*
+    writes the page numbers sitting in the buffer pool to "<db file>-warm", the
+    ones used since the clock hand last went by first. it's only a hint, so
+    it doesn't get synced and a stale or torn one is just ignored
+*/
+void pager_save_warm_set(pager_t* pager)
+{
+    warm_header_t header;
+    u64* page_nums;
+    u32 i, pass, count;
+    frame_t* frame;
+    int fd;
+
+    if (!pager->warm_path) {
+        return;
+    }
+
+    page_nums = xmalloc((pager->num_frames + 1) * sizeof(u64));
+    for (pass = 0, count = 0; pass != 2; ++pass) {
+        for (i = 0; i != pager->num_frames; ++i) {
+            frame = &pager->frames[i];
+            if (frame->page_num != INVALID_PAGE_NUM && frame->referenced == !pass) {
+                page_nums[count++] = frame->page_num;
+            }
+        }
+    }
+
+    header.magic = WARM_MAGIC;
+    header.page_size = PAGE_SIZE;
+    header.num_pages = count;
+    header.checksum = wal_checksum(page_nums, count * sizeof(u64), 0);
+
+    fd = open(pager->warm_path, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (fd >= 0) {
+        if (write(fd, &header, sizeof(header)) != sizeof(header)
+            || write(fd, page_nums, count * sizeof(u64)) != (ssize_t)(count * sizeof(u64))) {
+            // a short one fails the size check on the next open
+            printf("failed to save the buffer pool's pages, %d.\n", errno);
+        }
+        close(fd);
+    }
+
+    xfree(page_nums);
+}
+
+/*
+    reads the pages listed in "<db file>-warm" back into the buffer pool, so
+    the upper levels of the tree and the hottest leaves are there before the
+    first statement asks for them
+*/
+void pager_warm_start(pager_t* pager)
+{
+    warm_header_t header;
+    u64* page_nums;
+    u32 i, count;
+    int fd;
+
+    if (!pager->warm_path || !pager->num_pages) {
+        return;
+    }
+
+    fd = open(pager->warm_path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (read(fd, &header, sizeof(header)) != sizeof(header) || header.magic != WARM_MAGIC
+        || header.page_size != PAGE_SIZE) {
+        close(fd);
+        return;
+    }
+
+    page_nums = xmalloc(((size_t)header.num_pages + 1) * sizeof(u64));
+    if (read(fd, page_nums, header.num_pages * sizeof(u64))
+            != (ssize_t)(header.num_pages * sizeof(u64))
+        || wal_checksum(page_nums, header.num_pages * sizeof(u64), 0) != header.checksum) {
+        close(fd);
+        xfree(page_nums);
+        return;
+    }
+    close(fd);
+
+    // the pool may have shrunk since, keep the hottest. then drop pages the
+    // db doesn't have anymore and sort the rest so they can be read in runs
+    count = header.num_pages < pager->num_frames ? header.num_pages : pager->num_frames;
+    for (i = 0, header.num_pages = count, count = 0; i != header.num_pages; ++i) {
+        if (page_nums[i] < pager->num_pages) {
+            page_nums[count++] = page_nums[i];
+        }
+    }
+    qsort(page_nums, count, sizeof(u64), compare_page_nums);
+
+    pager_preload(pager, page_nums, count);
+    xfree(page_nums);
+}
+
+/*
+    reads a sorted list of pages into the buffer pool, pages that are next to
+    each other in the db file with a single read
+*/
+void pager_preload(pager_t* pager, u64* page_nums, u32 count)
+{
+    struct iovec iov[MAX_RUN_PAGES];
+    frame_t* frame;
+    u64 on_disk, run_start;
+    u32 i, frame_num, run_len;
+
+    if (pager->ring) {
+        for (i = 0; i < count; i += URING_ENTRIES) {
+            pager_prefetch(pager, page_nums + i,
+                count - i < URING_ENTRIES ? count - i : URING_ENTRIES);
+        }
+        return;
+    }
+
+    on_disk = pager->file_len / PAGE_SIZE;
+    run_start = 0, run_len = 0;
+    for (i = 0; i != count; ++i) {
+        if (pager_find_frame(pager, page_nums[i])) {
+            continue;
+        }
+
+        // the latest copy of this one is in the log
+        if (pager->wal
+            && (frame_num = wal_index_lookup(pager->wal, page_nums[i])) != WAL_NO_FRAME) {
+            frame = pager_get_victim(pager);
+            wal_read_page(pager->wal, frame_num, frame->data);
+            pager_install_frame(pager, frame, page_nums[i]);
+            continue;
+        }
+        if (page_nums[i] >= on_disk) {
+            continue;
+        }
+
+        if (run_len && (page_nums[i] != run_start + run_len || run_len == MAX_RUN_PAGES)) {
+            pager_read_run(pager, run_start, iov, run_len);
+            run_len = 0;
+        }
+        if (!run_len) {
+            run_start = page_nums[i];
+        }
+
+        frame = pager_get_victim(pager);
+        pager_install_frame(pager, frame, page_nums[i]);
+        iov[run_len].iov_base = frame->data;
+        iov[run_len].iov_len = PAGE_SIZE;
+        run_len++;
+    }
+
+    if (run_len) {
+        pager_read_run(pager, run_start, iov, run_len);
+    }
+
+    if (pager->verify_mode != VERIFY_MODE_READ) {
+        return;
+    }
+    for (i = 0; i != count; ++i) {
+        frame = pager_find_frame(pager, page_nums[i]);
+        if (frame && frame->unverified) {
+            pager_verify_frame(frame);
+        }
+    }
+}
+
+void pager_read_run(pager_t* pager, u64 first_page_num, struct iovec* iov, u32 run_len)
+{
+    ssize_t bytes_read;
+    size_t got;
+    u32 i;
+
+    bytes_read = preadv(pager->fd, iov, run_len, (off_t)first_page_num * PAGE_SIZE);
+    if (bytes_read < 0) {
+        printf("failed to read in data from file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    // whatever is past the end of file reads as zeros
+    for (i = 0; i != run_len; ++i) {
+        if (bytes_read >= (ssize_t)(i + 1) * PAGE_SIZE) {
+            continue;
+        }
+        got = bytes_read > (ssize_t)i * PAGE_SIZE ? bytes_read - (size_t)i * PAGE_SIZE : 0;
+        memset(iov[i].iov_base + got, 0x0, PAGE_SIZE - got);
+    }
+
+    for (i = 0; i != run_len; ++i) {
+        pager_inflate(pager, first_page_num + i, iov[i].iov_base);
+    }
+}
+
+int compare_page_nums(const void* a, const void* b)
+{
+    u64 x = *(const u64*)a, y = *(const u64*)b;
+
+    return (x > y) - (x < y);
+}
+
+// H E A D E R  &  F R E E L I S T
+void pager_init_header(pager_t* pager)
+{
+    memset(&pager->header, 0x0, sizeof(db_header_t));
+    pager->header.magic = DB_HEADER_MAGIC;
+    pager->header.version = DB_HEADER_VERSION;
+    pager->header.page_size = PAGE_SIZE;
+    pager->header.tree_height = 1;
+    pager->header.flags = pager->compress ? DB_FLAG_COMPRESSED : 0;
+    if (!pager->internal_max_keys) {
+        pager->internal_max_keys = INTERNAL_NODE_MAX_KEYS;
+    }
+    pager->header.internal_max_keys = pager->internal_max_keys;
+    pager->header_dirty = true;
+
+    // page 0 is taken even before it's written out
+    if (pager->num_pages == 0) {
+        pager->num_pages = 1;
+    }
+}
+
+/*
+    reads the header straight from the db file, once, when it's opened. it's
+    the only place the size of the db is taken from since the file may have
+    room preallocated past its last page
+*/
+void pager_read_header(pager_t* pager)
+{
+    ssize_t bytes_read;
+    void* page;
+    u32 max_keys;
+
+    page = xmalloc(PAGE_SIZE);
+    bytes_read = pread(pager->fd, page, PAGE_SIZE, 0);
+    memcpy(&pager->header, page, sizeof(db_header_t));
+
+    // nothing was ever written to it, only its extent was reserved. it's a
+    // new db as far as we're concerned
+    if (bytes_read == PAGE_SIZE && page_is_zeroed(page)) {
+        memset(&pager->header, 0x0, sizeof(db_header_t));
+        pager->num_pages = 0;
+        pager->header_dirty = false;
+        xfree(page);
+        return;
+    }
+    if (bytes_read != PAGE_SIZE || pager->header.magic != DB_HEADER_MAGIC) {
+        printf("db file has no valid header. Corrupt database file.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pager->header.version != DB_HEADER_VERSION) {
+        printf("db file format version %d is not supported.\n", pager->header.version);
+        exit(EXIT_FAILURE);
+    }
+    if (pager->header.page_size != PAGE_SIZE) {
+        printf("db file uses %d byte pages, expected %d.\n", pager->header.page_size,
+            PAGE_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    if (pager->verify_mode != VERIFY_MODE_CHECK && !page_checksum_ok(page)) {
+        printf("page 0 failed its checksum. Corrupt database file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    xfree(page);
+
+    // the tree's nodes were split at the db's own cap, a lower one would leave
+    // them too full
+    max_keys = pager->header.internal_max_keys;
+    if (!max_keys || max_keys > INTERNAL_NODE_MAX_KEYS) {
+        max_keys = INTERNAL_NODE_MAX_KEYS;
+    }
+    if (pager->internal_max_keys && pager->internal_max_keys != max_keys) {
+        printf("--max-keys is set when the db is created, this one's internal nodes hold up "
+               "to %d keys.\n",
+            max_keys);
+        exit(EXIT_FAILURE);
+    }
+    pager->internal_max_keys = max_keys;
+
+    // the flag has to be on disk before the first compressed page is
+    if (pager->compress && !(pager->header.flags & DB_FLAG_COMPRESSED)) {
+        pager->header.flags |= DB_FLAG_COMPRESSED;
+        pager_flush_header(pager);
+    }
+    if ((off_t)pager->header.num_pages * PAGE_SIZE > pager->file_len) {
+        printf("db file is shorter than its header says. Corrupt database file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pager->num_pages = pager->header.num_pages;
+    pager->header_dirty = false;
+}
+
+/*
+    writes the header straight to page 0 of the db file and syncs it, bypassing
+    the pool and the log. only for the times it has to be on disk before any
+    other page is: a new db and the compressed flag being turned on
+*/
+void pager_flush_header(pager_t* pager)
+{
+    void* page;
+
+    page = xmemalign(PAGE_SIZE, PAGE_SIZE);
+    memcpy(page, &pager->header, sizeof(db_header_t));
+    page_set_checksum(page);
+    if (pwrite(pager->fd, page, PAGE_SIZE, 0) != PAGE_SIZE || fdatasync(pager->fd) < 0) {
+        printf("failed to write the db header, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    free_mem(page);
+
+    if (pager->file_len < PAGE_SIZE) {
+        pager->file_len = PAGE_SIZE;
+    }
+    if (pager->alloc_len < PAGE_SIZE) {
+        pager->alloc_len = PAGE_SIZE;
+    }
+}
+
+bool page_is_zeroed(void* page)
+{
+    u64* word;
+
+    for (word = page; (void*)word != page + PAGE_SIZE; ++word) {
+        if (*word) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void pager_write_header(pager_t* pager)
+{
+    if (pager->header.num_pages != pager->num_pages) {
+        pager->header.num_pages = pager->num_pages;
+        pager->header_dirty = true;
+    }
+    if (!pager->header_dirty) {
+        return;
+    }
+
+    memcpy(get_page(pager, HEADER_PAGE_NUM), &pager->header, sizeof(db_header_t));
+    pager_mark_dirty(pager, HEADER_PAGE_NUM);
+    pager->header_dirty = false;
+}
+
+/*
+    picks the page size and works out every layout constant that depends on
+    it. has to be called before any page is touched
+*/
+void set_page_size(u32 page_size)
+{
+    PAGE_SIZE = page_size;
+
+    LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE - PAGE_TRAILER_SIZE;
+    LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+    LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
+    LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+    LEAF_NODE_MIN_CELLS = LEAF_NODE_MAX_CELLS / 2;
+
+    INTERNAL_NODE_MAX_KEYS
+        = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE - PAGE_TRAILER_SIZE) / INTERNAL_NODE_CELL_SIZE;
+
+    FREELIST_TRUNK_MAX_LEAVES
+        = (PAGE_SIZE - FREELIST_LEAVES_OFFSET - PAGE_TRAILER_SIZE) / sizeof(u64);
+}
+
+bool is_valid_page_size(u32 page_size)
+{
+    return page_size >= MIN_PAGE_SIZE && page_size <= MAX_PAGE_SIZE
+        && !(page_size & (page_size - 1));
+}
+
+void print_header(pager_t* pager)
+{
+    printf("version: %d\n", pager->header.version);
+    printf("page size: %d\n", pager->header.page_size);
+    printf("root page: %llu\n", pager->header.root_page);
+    printf("pages: %llu\n", pager->num_pages);
+    printf("free pages: %llu\n", pager->header.freelist_count);
+    printf("rows: %llu\n", pager->header.num_rows);
+    printf("tree height: %d\n", pager->header.tree_height);
+}
+
+/*
+    hands a page that's no longer used back to the freelist. it goes into the
+    first trunk if there's room left, otherwise the page itself becomes the
+    new first trunk. the contents of a freed leaf page are left as they are,
+    whoever gets it next re-initializes it anyway
+*/
+void pager_free_page(pager_t* pager, u64 page_num)
+{
+    db_header_t* header = &pager->header;
+    void* trunk;
+    u32* num_leaves;
+
+    if (header->freelist_trunk) {
+        trunk = get_page(pager, header->freelist_trunk);
+        num_leaves = freelist_num_leaves(trunk);
+
+        if (*num_leaves < FREELIST_TRUNK_MAX_LEAVES) {
+            *freelist_leaf(trunk, (*num_leaves)++) = page_num;
+            pager_mark_dirty(pager, header->freelist_trunk);
+
+            header->freelist_count++;
+            pager->header_dirty = true;
+            return;
+        }
+    }
+
+    trunk = get_page(pager, page_num);
+    *freelist_next_trunk(trunk) = header->freelist_trunk;
+    *freelist_num_leaves(trunk) = 0;
+    pager_mark_dirty(pager, page_num);
+
+    header->freelist_trunk = page_num;
+    header->freelist_count++;
+    pager->header_dirty = true;
+}
+
+u64* freelist_next_trunk(void* trunk) { return trunk + FREELIST_NEXT_TRUNK_OFFSET; }
 
-    offset = lseek(pager->fd, page_num * PAGE_SIZE, SEEK_SET);
-    if (offset < 0) {
-        printf("failed to reposition for the current page, %d.\n", errno);
-        exit(EXIT_FAILURE);
-    }
+u32* freelist_num_leaves(void* trunk) { return trunk + FREELIST_NUM_LEAVES_OFFSET; }
 
-    bytes_written = write(pager->fd, pager->pages[page_num], PAGE_SIZE);
-    if (bytes_written < 0) {
-        perror("error writing page cache to disk:");
-        exit(EXIT_FAILURE);
-    }
+u64* freelist_leaf(void* trunk, u32 leaf_num)
+{
+    return trunk + FREELIST_LEAVES_OFFSET + leaf_num * sizeof(u64);
 }
 
 // B - T R E E  S P E C I F I C S
@@ -238,11 +2927,11 @@ void* leaf_node_cell(void* node, u32 cell_num)
 
 bool is_last_leaf_node(void* node)
 {
-    u32 page_num = *leaf_node_next_leaf(node);
+    u64 page_num = *leaf_node_next_leaf(node);
     return page_num == NO_SIBLING;
 }
 
-u32* leaf_node_next_leaf(void* node) { return (u32*)(node + LEAF_NODE_NEXT_LEAF_OFFSET); }
+u64* leaf_node_next_leaf(void* node) { return (u64*)(node + LEAF_NODE_NEXT_LEAF_OFFSET); }
 
 void init_leaf_node(void* node)
 {
@@ -264,11 +2953,12 @@ void init_internal_node(void* node)
     *num_keys = 0x0;
 
     /*
-        needed because the root page number is 0; by not setting this to
-        INVALID_PAGE_NUM, we'd be pointing to the first page in the db file,
-        which is the "root page", thus making the node the parent of the root
+        needed because a zeroed right child would point to the first page in
+        the db file, which is the header page, thus making the node look like
+        it has a child it doesn't have
     */
     *internal_node_right_child(node) = INVALID_PAGE_NUM;
+    *internal_node_max_key(node) = 0x0;
 }
 
 u32* leaf_node_key(void* node, u32 cell_num) { return leaf_node_cell(node, cell_num); }
@@ -286,6 +2976,37 @@ void print_constants(void)
     printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
     printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_SPACE_FOR_CELLS);
     printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
+    printf("INTERNAL_NODE_MAX_KEYS: %d\n", INTERNAL_NODE_MAX_KEYS);
+}
+
+void print_pager_stats(pager_t* pager)
+{
+    u32 i, resident;
+
+    for (i = 0, resident = 0; i != pager->num_frames; ++i) {
+        resident += (pager->frames[i].page_num != INVALID_PAGE_NUM);
+    }
+
+    printf("mode: %s\n", pager->mode == PAGER_MODE_MMAP ? "mmap" : "buffered");
+    printf("pages: %llu\n", pager->num_pages);
+    printf("allocated: %llu\n", (u64)pager->alloc_len / PAGE_SIZE);
+    printf("free: %llu\n", pager->header.freelist_count);
+    if (pager->mode == PAGER_MODE_MMAP) {
+        printf("mapped: %zu\n", pager->map_len / PAGE_SIZE);
+    } else {
+        // compressed pages are written back one by one, see pager_checkpoint()
+        printf("io: %s%s%s\n", pager->ring ? "io_uring" : "sync",
+            pager->ring && pager->compress ? "( reads only )" : "",
+            pager->direct ? ", direct" : "");
+        printf("frames: %d\n", pager->num_frames);
+        printf("resident: %d\n", resident);
+        printf("pinned: %d\n", pager->num_pinned);
+    }
+    printf("read ahead: %llu\n", pager->ra.num_pages);
+    printf("dirty: %d\n", pager->num_dirty);
+    if (pager->wal) {
+        printf("wal frames: %d\n", pager->wal->num_frames);
+    }
 }
 
 void indent(u32 level)
@@ -301,10 +3022,11 @@ void indent(u32 level)
     printf("%s", spaces);
 }
 
-void print_tree(pager_t* pager, u32 page_num, u32 indentation_level)
+void print_tree(pager_t* pager, u64 page_num, u32 indentation_level)
 {
     void* node;
-    u32 num_keys, child, i;
+    u32 num_keys, i;
+    u64 child;
 
     node = get_page(pager, page_num);
     switch (get_node_type(node)) {
@@ -328,7 +3050,11 @@ void print_tree(pager_t* pager, u32 page_num, u32 indentation_level)
             for (i = 0; i != num_keys; ++i) {
                 child = *internal_node_left_child(node, i);
 
+                // the subtree can push this node out of the pool, so it's
+                // looked up again rather than pinned for the whole walk
                 print_tree(pager, child, indentation_level + 1);
+                node = get_page(pager, page_num);
+
                 indent(indentation_level + 1);
                 printf("- key %d\n", *internal_node_key(node, i));
             }
@@ -367,6 +3093,33 @@ void leaf_node_insert(cursor_t* c, u32 key, row_t* value)
     *(leaf_node_num_cells(node)) += 1;
     *(leaf_node_key(node, c->cell_num)) = key;
     serialize_row(value, leaf_node_value(node, c->cell_num)); // store row
+    pager_mark_dirty(c->table->pager, c->page_num);
+
+    // a new max key for the leaf may be one for the nodes above it as well
+    if (c->cell_num == num_cells) {
+        update_ancestor_max_keys(c->table->pager, node, key);
+    }
+}
+
+/*
+    "key" went in under "node" as its new max key. it's the new max key of
+    every ancestor that has "node" down its right spine, the walk up stops
+    at the first one that already has a bigger key under it
+*/
+void update_ancestor_max_keys(pager_t* pager, void* node, u32 key)
+{
+    u64 page_num;
+
+    while (!is_node_root(node)) {
+        page_num = *node_parent(node);
+        node = get_page(pager, page_num);
+        if (*internal_node_max_key(node) >= key) {
+            return;
+        }
+
+        *internal_node_max_key(node) = key;
+        pager_mark_dirty(pager, page_num);
+    }
 }
 
 node_type_t get_node_type(void* node)
@@ -381,7 +3134,7 @@ void set_node_type(void* node, node_type_t type)
     *((u8*)(node + NODE_TYPE_OFFSET)) = val;
 }
 
-cursor_t* leaf_node_find(table_t* t, u32 page_num, u32 key)
+cursor_t* leaf_node_find(table_t* t, u64 page_num, u32 key)
 {
     void* node;
     u32 num_cells, key_at_mid;
@@ -417,12 +3170,13 @@ cursor_t* leaf_node_find(table_t* t, u32 page_num, u32 key)
     return c;
 }
 
-u32* node_parent(void* node) { return node + PARENT_POINTER_OFFSET; }
+u64* node_parent(void* node) { return node + PARENT_POINTER_OFFSET; }
 
 void leaf_node_split_and_insert(cursor_t* c, u32 key, row_t* value)
 {
     void *old_node, *new_node, *dest_node, *dest, *src, *saved_value;
-    u32 new_page_num, index_within_node, old_max;
+    u32 index_within_node, old_max;
+    u64 new_page_num;
     int i;
 
     /*
@@ -430,10 +3184,10 @@ void leaf_node_split_and_insert(cursor_t* c, u32 key, row_t* value)
         - insert the new value in one of the 2 nodes
         - update the parent or create a new parent
     */
-    old_node = get_page(c->table->pager, c->page_num);
-    old_max = get_node_max_key(c->table->pager, old_node);
+    old_node = pager_pin(c->table->pager, c->page_num);
+    old_max = get_node_max_key(old_node);
     new_page_num = get_unused_page_num(c->table->pager);
-    new_node = get_page(c->table->pager, new_page_num);
+    new_node = pager_pin(c->table->pager, new_page_num);
     init_leaf_node(new_node);
 
     // the old node's parent is the new node's parent too
@@ -474,33 +3228,68 @@ void leaf_node_split_and_insert(cursor_t* c, u32 key, row_t* value)
     // update cell count on both nodes
     *(leaf_node_num_cells(old_node)) = LEAF_NODE_LEFT_SPLIT_COUNT;
     *(leaf_node_num_cells(new_node)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+    pager_mark_dirty(c->table->pager, c->page_num);
+    pager_mark_dirty(c->table->pager, new_page_num);
 
     // update the parent
     if (is_node_root(old_node)) {
-        return create_new_root(c->table, new_page_num);
+        create_new_root(c->table, new_page_num);
     } else {
-        u32 parent_page_num = *node_parent(old_node);
-        u32 new_max = get_node_max_key(c->table->pager, old_node);
+        u64 parent_page_num = *node_parent(old_node);
+        u32 new_max = get_node_max_key(old_node);
         void* parent = get_page(c->table->pager, parent_page_num);
 
         update_internal_node_key(parent, old_max, new_max);
+        pager_mark_dirty(c->table->pager, parent_page_num);
         internal_node_insert(c->table, parent_page_num, new_page_num);
     }
+
+    pager_unpin(c->table->pager, new_page_num);
+    pager_unpin(c->table->pager, c->page_num);
 }
 
 void update_internal_node_key(void* node, u32 old_key, u32 new_key)
 {
-    // overwrite the old key with the new key
+    // overwrite the old key with the new key. the right child has no key of
+    // its own, its max is the node's
     u32 old_child_idx = internal_node_find_child(node, old_key);
-    *internal_node_key(node, old_child_idx) = new_key;
+    if (old_child_idx < *internal_node_num_keys(node)) {
+        *internal_node_key(node, old_child_idx) = new_key;
+    }
 }
 
 /*
-    Until we start recycling free pages, new pages will be added
-    at the end of the db file
+    allocates a page, reusing the most recently freed one if there is any.
+    only when the freelist is empty does the db file grow
 */
-// todo: needs to get a better way of finding unused pages
-u32 get_unused_page_num(pager_t* pager) { return pager->num_pages; }
+u64 get_unused_page_num(pager_t* pager)
+{
+    db_header_t* header = &pager->header;
+    void* trunk;
+    u64 page_num;
+    u32* num_leaves;
+
+    if (!header->freelist_trunk) {
+        pager_reserve(pager, pager->num_pages + 1);
+        return pager->num_pages++;
+    }
+
+    header->freelist_count--;
+    pager->header_dirty = true;
+
+    trunk = get_page(pager, header->freelist_trunk);
+    num_leaves = freelist_num_leaves(trunk);
+    if (*num_leaves) {
+        pager_mark_dirty(pager, header->freelist_trunk);
+        return *freelist_leaf(trunk, --(*num_leaves));
+    }
+
+    // an empty trunk is handed out itself
+    page_num = header->freelist_trunk;
+    header->freelist_trunk = *freelist_next_trunk(trunk);
+
+    return page_num;
+}
 
 bool is_node_root(void* node)
 {
@@ -514,7 +3303,7 @@ void set_node_root(void* node, bool is_root)
     *((u8*)(node + IS_ROOT_OFFSET)) = value;
 }
 
-void create_new_root(table_t* t, u32 right_child_page_num)
+void create_new_root(table_t* t, u64 right_child_page_num)
 {
     /*
     Logic of splitting:
@@ -536,37 +3325,36 @@ void create_new_root(table_t* t, u32 right_child_page_num)
         New root node points to two children
     */
     void *root, *left_child, *right_child;
-    u32 left_child_page_num, left_child_max_key;
+    u32 left_child_max_key;
+    u64 left_child_page_num;
 
-    root = get_page(t->pager, t->root_page_num);
-    right_child = get_page(t->pager, right_child_page_num);
+    root = pager_pin(t->pager, t->root_page_num);
+    right_child = pager_pin(t->pager, right_child_page_num);
 
     left_child_page_num = get_unused_page_num(t->pager);
-    left_child = get_page(t->pager, left_child_page_num);
+    left_child = pager_pin(t->pager, left_child_page_num);
 
-    if (get_node_type(root) == NODE_INTERNAL) {
-        init_internal_node(right_child);
-        init_internal_node(left_child);
-    }
-
-    // copy all data in root over to left child
+    // copy all data in root over to left child. the right child is already
+    // filled in by whoever split the root
     memcpy(left_child, root, PAGE_SIZE);
     set_node_root(left_child, false);
 
     if (get_node_type(left_child) == NODE_INTERNAL) {
         void* child;
-        u32 curr_page_num;
+        u64 curr_page_num;
         int i;
 
         for (i = 0; i != *internal_node_num_keys(left_child); ++i) {
             curr_page_num = *internal_node_left_child(left_child, i);
             child = get_page(t->pager, curr_page_num);
             *node_parent(child) = left_child_page_num;
+            pager_mark_dirty(t->pager, curr_page_num);
         }
 
         curr_page_num = *internal_node_right_child(left_child);
         child = get_page(t->pager, curr_page_num);
         *node_parent(child) = left_child_page_num;
+        pager_mark_dirty(t->pager, curr_page_num);
     }
 
     // root node is now internal with one key and 2 children
@@ -574,13 +3362,25 @@ void create_new_root(table_t* t, u32 right_child_page_num)
     set_node_root(root, true);
     *internal_node_num_keys(root) = 0x1;
     *internal_node_left_child(root, 0x0) = left_child_page_num;
-    left_child_max_key = get_node_max_key(t->pager, left_child);
+    left_child_max_key = get_node_max_key(left_child);
     *internal_node_key(root, 0x0) = left_child_max_key;
     *internal_node_right_child(root) = right_child_page_num;
+    *internal_node_max_key(root) = get_node_max_key(right_child);
 
     // update parent of children
     *node_parent(left_child) = t->root_page_num;
     *node_parent(right_child) = t->root_page_num;
+
+    t->pager->header.tree_height++;
+    t->pager->header_dirty = true;
+
+    pager_mark_dirty(t->pager, t->root_page_num);
+    pager_mark_dirty(t->pager, left_child_page_num);
+    pager_mark_dirty(t->pager, right_child_page_num);
+
+    pager_unpin(t->pager, left_child_page_num);
+    pager_unpin(t->pager, right_child_page_num);
+    pager_unpin(t->pager, t->root_page_num);
 }
 
 u32* internal_node_key(void* node, u32 key_num)
@@ -599,9 +3399,10 @@ u32* internal_node_key(void* node, u32 key_num)
     return (u32*)(node_cell + INTERNAL_NODE_CHILD_SIZE);
 }
 
-u32* internal_node_left_child(void* node, u32 child_num)
+u64* internal_node_left_child(void* node, u32 child_num)
 {
-    u32 num_keys, *right_child, *left_child;
+    u32 num_keys;
+    u64 *right_child, *left_child;
 
     num_keys = *internal_node_num_keys(node);
     if (child_num > num_keys) {
@@ -634,35 +3435,35 @@ u32* internal_node_left_child(void* node, u32 child_num)
     return left_child;
 }
 
-u32* internal_node_cell(void* node, u32 cell_num)
+u64* internal_node_cell(void* node, u32 cell_num)
 {
     u32 offset = (INTERNAL_NODE_HEADER_SIZE + (cell_num * INTERNAL_NODE_CELL_SIZE));
 
     return node + offset;
 }
 
-u32* internal_node_right_child(void* node)
+u64* internal_node_right_child(void* node)
 {
     return node + INTERNAL_NODE_RIGHT_CHILD_OFFSET;
 }
 
 u32* internal_node_num_keys(void* node) { return node + INTERNAL_NODE_NUM_KEYS_OFFSET; }
 
-u32 get_node_max_key(pager_t* pager, void* node)
+u32* internal_node_max_key(void* node) { return node + INTERNAL_NODE_MAX_KEY_OFFSET; }
+
+u32 get_node_max_key(void* node)
 {
     u32 key;
-    void* right_child;
 
     /*
-        - for internal nodes, the max key is the rightmost key i.e. the
-          "num_keys"-th key
+        - for internal nodes, the max key is kept in the header, it's the
+          right child's max key
         - for leaf nodes, the max key is the key with the highest
           index i.e. the "num_cells"-th key
     */
     switch (get_node_type(node)) {
     case NODE_INTERNAL:
-        right_child = get_page(pager, *internal_node_right_child(node));
-        key = get_node_max_key(pager, right_child);
+        key = *internal_node_max_key(node);
         break;
     case NODE_LEAF:
         key = *leaf_node_key(node, *leaf_node_num_cells(node) - 0x1);
@@ -704,10 +3505,11 @@ u32 internal_node_find_child(void* node, u32 key)
     return min_idx;
 }
 
-cursor_t* internal_node_find(table_t* t, u32 page_num, u32 key)
+cursor_t* internal_node_find(table_t* t, u64 page_num, u32 key)
 {
     cursor_t* c;
-    u32 child_index, child_num;
+    u32 child_index;
+    u64 child_num;
     void *node, *child;
 
     node = get_page(t->pager, page_num);
@@ -730,20 +3532,24 @@ cursor_t* internal_node_find(table_t* t, u32 page_num, u32 key)
     return c;
 }
 
-void internal_node_insert(table_t* t, u32 parent_page_num, u32 child_page_num)
+void internal_node_insert(table_t* t, u64 parent_page_num, u64 child_page_num)
 {
     // Add a new child/key pair to parent that corresponds to child
-    void *parent, *child, *right_child, *dest, *src;
-    u32 child_max_key, index, original_num_keys, right_child_page_num, right_child_max_key;
+    void *parent, *child, *dest, *src;
+    u32 child_max_key, index, original_num_keys, right_child_max_key;
+    u64 right_child_page_num;
     int i;
 
-    parent = get_page(t->pager, parent_page_num);
-    child = get_page(t->pager, child_page_num);
-    child_max_key = get_node_max_key(t->pager, child);
+    parent = pager_pin(t->pager, parent_page_num);
+    child = pager_pin(t->pager, child_page_num);
+    child_max_key = get_node_max_key(child);
     index = internal_node_find_child(parent, child_max_key);
 
     original_num_keys = *internal_node_num_keys(parent);
-    if (original_num_keys >= INTERNAL_NODE_MAX_KEYS) {
+    if (original_num_keys >= t->pager->internal_max_keys) {
+        // the split pins what it needs itself
+        pager_unpin(t->pager, child_page_num);
+        pager_unpin(t->pager, parent_page_num);
         return internal_node_split_and_insert(t, parent_page_num, child_page_num);
     }
 
@@ -756,14 +3562,13 @@ void internal_node_insert(table_t* t, u32 parent_page_num, u32 child_page_num)
         "preemptively" guard against accessing and manipulating memory not
         assigned to our b+-tree
     */
-    if (right_child_page_num == INVALID_PAGE_NUM
-        || right_child_page_num > INVALID_PAGE_NUM) {
+    if (right_child_page_num == INVALID_PAGE_NUM) {
         *internal_node_right_child(parent) = child_page_num;
-        return;
+        *internal_node_max_key(parent) = child_max_key;
+        pager_mark_dirty(t->pager, parent_page_num);
+        goto out;
     }
 
-    right_child = get_page(t->pager, right_child_page_num);
-
     /*
         if we're at the max number of cells for a node, we cannot increment
         before splitting. Incrementing without inserting a new key/child pair
@@ -772,15 +3577,19 @@ void internal_node_insert(table_t* t, u32 parent_page_num, u32 child_page_num)
     */
     *internal_node_num_keys(parent) = original_num_keys + 1;
 
-    // if the new child is the rightmost child
-    if (child_max_key > get_node_max_key(t->pager, right_child)) {
+    // if the new child is the rightmost child. the right child may have just
+    // split, so its max key is read from it rather than the parent's
+    right_child_max_key = get_node_max_key(get_page(t->pager, right_child_page_num));
+    if (child_max_key > right_child_max_key) {
         // replace right child by doing a swap of the left kid with the right
         // one
-        right_child_max_key = get_node_max_key(t->pager, right_child);
-
         *internal_node_left_child(parent, original_num_keys) = right_child_page_num;
         *internal_node_key(parent, original_num_keys) = right_child_max_key;
         *internal_node_right_child(parent) = child_page_num;
+        if (child_max_key > *internal_node_max_key(parent)) {
+            *internal_node_max_key(parent) = child_max_key;
+            update_ancestor_max_keys(t->pager, parent, child_max_key);
+        }
     } else {
         // make room for new cell
         for (i = original_num_keys; i > index; --i) {
@@ -792,168 +3601,951 @@ void internal_node_insert(table_t* t, u32 parent_page_num, u32 child_page_num)
         *internal_node_left_child(parent, index) = child_page_num;
         *internal_node_key(parent, index) = child_max_key;
     }
+
+    pager_mark_dirty(t->pager, parent_page_num);
+
+out:
+    pager_unpin(t->pager, child_page_num);
+    pager_unpin(t->pager, parent_page_num);
+}
+
+/*
+    "parent_page_num" is full, so it's split in two to make room for
+    "child_page_num". the new node takes the upper half of the children and
+    goes into the parent's parent right after the old one, which may split
+    that one in turn, all the way up to the root.
+
+    the children are moved in place, the ones that end up in the new node
+    first and then the rest, highest first, so nothing's overwritten before
+    it's read. see internal_split_child() for where each of them comes from
+*/
+void internal_node_split_and_insert(table_t* t, u64 parent_page_num, u64 child_page_num)
+{
+    internal_split_t split;
+    void *old_node, *new_node, *child, *moved, *grandparent;
+    u32 num_children, left_count, left_max, old_max, key, i;
+    u64 new_page_num, moved_page_num, grandparent_page_num;
+
+    old_node = pager_pin(t->pager, parent_page_num);
+    child = pager_pin(t->pager, child_page_num);
+
+    split.node = old_node;
+    split.num_keys = *internal_node_num_keys(old_node);
+    split.right_child = *internal_node_right_child(old_node);
+    split.new_child = child_page_num;
+    split.new_max = get_node_max_key(child);
+
+    // the node's max key is still the one its parent knows it by, but the
+    // right child may have just split and lost its upper half to "child"
+    old_max = get_node_max_key(old_node);
+    split.right_max = get_node_max_key(get_page(t->pager, split.right_child));
+    split.insert_at = split.new_max > split.right_max
+        ? split.num_keys + 1
+        : internal_node_find_child(old_node, split.new_max);
+
+    // the old node keeps the lower half, it's the smaller one when it's odd
+    num_children = split.num_keys + 2;
+    left_count = num_children / 2;
+
+    new_page_num = get_unused_page_num(t->pager);
+    new_node = pager_pin(t->pager, new_page_num);
+    init_internal_node(new_node);
+    *internal_node_num_keys(new_node) = num_children - left_count - 1;
+
+    for (i = left_count; i != num_children; ++i) {
+        moved_page_num = internal_split_child(&split, i, &key);
+        if (i + 1 == num_children) {
+            *internal_node_right_child(new_node) = moved_page_num;
+            *internal_node_max_key(new_node) = key;
+        } else {
+            *internal_node_cell(new_node, i - left_count) = moved_page_num;
+            *internal_node_key(new_node, i - left_count) = key;
+        }
+
+        moved = get_page(t->pager, moved_page_num);
+        *node_parent(moved) = new_page_num;
+        pager_mark_dirty(t->pager, moved_page_num);
+    }
+
+    // the last child the old node keeps is its right child and has its max key
+    *internal_node_right_child(old_node)
+        = internal_split_child(&split, left_count - 1, &left_max);
+    for (i = left_count - 1; i--;) {
+        *internal_node_cell(old_node, i) = internal_split_child(&split, i, &key);
+        *internal_node_key(old_node, i) = key;
+    }
+    *internal_node_num_keys(old_node) = left_count - 1;
+    *internal_node_max_key(old_node) = left_max;
+    if (split.insert_at < left_count) {
+        *node_parent(child) = parent_page_num;
+        pager_mark_dirty(t->pager, child_page_num);
+    }
+
+    pager_mark_dirty(t->pager, parent_page_num);
+    pager_mark_dirty(t->pager, new_page_num);
+
+    if (is_node_root(old_node)) {
+        create_new_root(t, new_page_num);
+    } else {
+        // the new node's parent is set first, a split up there moves it on
+        grandparent_page_num = *node_parent(old_node);
+        grandparent = get_page(t->pager, grandparent_page_num);
+        update_internal_node_key(grandparent, old_max, left_max);
+        pager_mark_dirty(t->pager, grandparent_page_num);
+
+        *node_parent(new_node) = grandparent_page_num;
+        internal_node_insert(t, grandparent_page_num, new_page_num);
+    }
+
+    pager_unpin(t->pager, new_page_num);
+    pager_unpin(t->pager, child_page_num);
+    pager_unpin(t->pager, parent_page_num);
+}
+
+/*
+    child "index" of a node being split, counting the new child as if it was
+    already in place and the right child as the last of the old ones. hands
+    back its page and sets "max_key" to the biggest key under it
+*/
+u64 internal_split_child(internal_split_t* split, u32 index, u32* max_key)
+{
+    if (index == split->insert_at) {
+        *max_key = split->new_max;
+        return split->new_child;
+    }
+    if (index > split->insert_at) {
+        index--;
+    }
+
+    if (index == split->num_keys) {
+        *max_key = split->right_max;
+        return split->right_child;
+    }
+
+    *max_key = *internal_node_key(split->node, index);
+    return *internal_node_cell(split->node, index);
+}
+
+/*
+    takes "count" cells starting at the one the cursor points at out of its
+    leaf. if that took the leaf's max key, the nodes above get the new one. a
+    leaf left less than half full borrows from or merges with a sibling
+    afterwards
+*/
+void leaf_node_delete(cursor_t* c, u32 count)
+{
+    pager_t* pager = c->table->pager;
+    void* node;
+    u32 num_cells, old_max;
+
+    node = get_page(pager, c->page_num);
+    num_cells = *leaf_node_num_cells(node);
+    old_max = *leaf_node_key(node, num_cells - 1);
+
+    memmove(leaf_node_cell(node, c->cell_num), leaf_node_cell(node, c->cell_num + count),
+        (num_cells - c->cell_num - count) * LEAF_NODE_CELL_SIZE);
+    num_cells -= count;
+    *leaf_node_num_cells(node) = num_cells;
+    pager_mark_dirty(pager, c->page_num);
+
+    // an empty leaf has no max key, it gets merged away below anyway
+    if (c->cell_num == num_cells && num_cells) {
+        lower_ancestor_max_keys(pager, node, old_max, *leaf_node_key(node, num_cells - 1));
+    }
+
+    node_rebalance(c->table, c->page_num);
+}
+
+/*
+    "old_max" was the max key under "node" and now it's "new_max". the
+    separator that points at "node" gets fixed, and if "node" hangs off the
+    right spine of its parent the parent's max key changes too, so the walk
+    goes on up
+*/
+void lower_ancestor_max_keys(pager_t* pager, void* node, u32 old_max, u32 new_max)
+{
+    u64 page_num;
+    u32 index;
+
+    while (!is_node_root(node)) {
+        page_num = *node_parent(node);
+        node = get_page(pager, page_num);
+        pager_mark_dirty(pager, page_num);
+
+        index = internal_node_find_child(node, old_max);
+        if (index < *internal_node_num_keys(node)) {
+            *internal_node_key(node, index) = new_max;
+            return;
+        }
+
+        *internal_node_max_key(node) = new_max;
+    }
+}
+
+// the slot "child_page_num" has in "node", the right child is the last one
+u32 internal_node_child_index(void* node, u64 child_page_num)
+{
+    u32 i, num_keys;
+
+    num_keys = *internal_node_num_keys(node);
+    for (i = 0; i < num_keys; ++i) {
+        if (*internal_node_cell(node, i) == child_page_num) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*
+    a node that's less than half full after a delete gets paired up with its
+    left sibling( the leftmost child with its right one ). if both fit in one
+    page they're merged and the parent loses a key, which may leave the parent
+    underfull in turn. otherwise the pair shares its cells out evenly
+*/
+void node_rebalance(table_t* t, u64 page_num)
+{
+    void *node, *parent, *left, *right;
+    u64 parent_page_num;
+    u32 index, left_count, right_count;
+    bool fits;
+
+    node = get_page(t->pager, page_num);
+    if (is_node_root(node)) {
+        if (get_node_type(node) == NODE_INTERNAL && !*internal_node_num_keys(node)) {
+            collapse_root(t);
+        }
+        return;
+    }
+
+    if (get_node_type(node) == NODE_LEAF) {
+        if (*leaf_node_num_cells(node) >= LEAF_NODE_MIN_CELLS) {
+            return;
+        }
+    } else if (*internal_node_num_keys(node) >= t->pager->internal_max_keys / 2) {
+        return;
+    }
+
+    parent_page_num = *node_parent(node);
+    parent = get_page(t->pager, parent_page_num);
+    if (!*internal_node_num_keys(parent)) {
+        return; // no sibling to lean on
+    }
+
+    index = internal_node_child_index(parent, page_num);
+    if (index) {
+        index--;
+    }
+
+    left = get_page(t->pager, *internal_node_left_child(parent, index));
+    right = get_page(t->pager, *internal_node_left_child(parent, index + 1));
+    if (get_node_type(node) == NODE_LEAF) {
+        left_count = *leaf_node_num_cells(left), right_count = *leaf_node_num_cells(right);
+        fits = left_count + right_count <= LEAF_NODE_MAX_CELLS;
+    } else {
+        // the left node's right child turns into a cell when they're merged
+        left_count = *internal_node_num_keys(left), right_count = *internal_node_num_keys(right);
+        fits = left_count + right_count + 1 <= t->pager->internal_max_keys;
+    }
+
+    if (!fits) {
+        node_redistribute(t, parent_page_num, index);
+        return;
+    }
+
+    node_merge(t, parent_page_num, index);
+    node_rebalance(t, parent_page_num);
+}
+
+/*
+    moves everything in child "index + 1" of the parent into child "index".
+    the left node takes over the right one's slot in the parent, its own slot
+    goes and the right node's page is freed
+*/
+void node_merge(table_t* t, u64 parent_page_num, u32 index)
+{
+    pager_t* pager = t->pager;
+    void *parent, *left, *right;
+    u64 left_page_num, right_page_num;
+    u32 i, num_keys, left_count, right_count, slot_max, merged_max;
+
+    parent = pager_pin(pager, parent_page_num);
+    left_page_num = *internal_node_left_child(parent, index);
+    right_page_num = *internal_node_left_child(parent, index + 1);
+    left = pager_pin(pager, left_page_num);
+    right = pager_pin(pager, right_page_num);
+
+    if (get_node_type(left) == NODE_LEAF) {
+        left_count = *leaf_node_num_cells(left), right_count = *leaf_node_num_cells(right);
+        memcpy(leaf_node_cell(left, left_count), leaf_node_cell(right, 0),
+            right_count * LEAF_NODE_CELL_SIZE);
+        *leaf_node_num_cells(left) = left_count + right_count;
+        *leaf_node_next_leaf(left) = *leaf_node_next_leaf(right);
+    } else {
+        left_count = *internal_node_num_keys(left), right_count = *internal_node_num_keys(right);
+        *internal_node_cell(left, left_count) = *internal_node_right_child(left);
+        *internal_node_key(left, left_count) = *internal_node_max_key(left);
+        memcpy(internal_node_cell(left, left_count + 1), internal_node_cell(right, 0),
+            right_count * INTERNAL_NODE_CELL_SIZE);
+        *internal_node_num_keys(left) = left_count + 1 + right_count;
+        *internal_node_right_child(left) = *internal_node_right_child(right);
+        *internal_node_max_key(left) = *internal_node_max_key(right);
+
+        for (i = left_count + 1; i <= left_count + 1 + right_count; ++i) {
+            reparent_node(pager, *internal_node_left_child(left, i), left_page_num);
+        }
+    }
+    pager_mark_dirty(pager, left_page_num);
+
+    /*
+        the right node's key in the parent may still be a key that was just
+        deleted, if the right node was the leaf it got deleted from and it
+        ended up empty
+    */
+    merged_max = get_node_max_key(left);
+    num_keys = *internal_node_num_keys(parent);
+    if (index + 1 == num_keys) {
+        *internal_node_right_child(parent) = left_page_num;
+        slot_max = *internal_node_max_key(parent);
+        if (slot_max != merged_max) {
+            *internal_node_max_key(parent) = merged_max;
+            lower_ancestor_max_keys(pager, parent, slot_max, merged_max);
+        }
+    } else {
+        *internal_node_cell(parent, index + 1) = left_page_num;
+        *internal_node_key(parent, index + 1) = merged_max;
+    }
+
+    memmove(internal_node_cell(parent, index), internal_node_cell(parent, index + 1),
+        (num_keys - index - 1) * INTERNAL_NODE_CELL_SIZE);
+    *internal_node_num_keys(parent) = num_keys - 1;
+    pager_mark_dirty(pager, parent_page_num);
+
+    pager_unpin(pager, right_page_num);
+    pager_unpin(pager, left_page_num);
+    pager_unpin(pager, parent_page_num);
+
+    pager_free_page(pager, right_page_num);
+}
+
+/*
+    evens out children "index" and "index + 1" of the parent when they're too
+    full to be merged. only the left node's max key changes, and that's just
+    the separator between the two
+*/
+void node_redistribute(table_t* t, u64 parent_page_num, u32 index)
+{
+    pager_t* pager = t->pager;
+    void *parent, *left, *right;
+    u64 left_page_num, right_page_num;
+    u32 left_count, right_count, target, moved;
+
+    parent = pager_pin(pager, parent_page_num);
+    left_page_num = *internal_node_left_child(parent, index);
+    right_page_num = *internal_node_left_child(parent, index + 1);
+    left = pager_pin(pager, left_page_num);
+    right = pager_pin(pager, right_page_num);
+
+    if (get_node_type(left) == NODE_LEAF) {
+        left_count = *leaf_node_num_cells(left), right_count = *leaf_node_num_cells(right);
+        target = (left_count + right_count + 1) / 2;
+
+        if (left_count > target) {
+            moved = left_count - target;
+            memmove(leaf_node_cell(right, moved), leaf_node_cell(right, 0),
+                right_count * LEAF_NODE_CELL_SIZE);
+            memcpy(leaf_node_cell(right, 0), leaf_node_cell(left, target),
+                moved * LEAF_NODE_CELL_SIZE);
+            right_count += moved;
+        } else {
+            moved = target - left_count;
+            memcpy(leaf_node_cell(left, left_count), leaf_node_cell(right, 0),
+                moved * LEAF_NODE_CELL_SIZE);
+            memmove(leaf_node_cell(right, 0), leaf_node_cell(right, moved),
+                (right_count - moved) * LEAF_NODE_CELL_SIZE);
+            right_count -= moved;
+        }
+
+        *leaf_node_num_cells(left) = target;
+        *leaf_node_num_cells(right) = right_count;
+    } else {
+        left_count = *internal_node_num_keys(left), right_count = *internal_node_num_keys(right);
+
+        // children go across one at a time, the left node's right child
+        // being the one next to the right node's first
+        for (; left_count + 1 < right_count; left_count++, right_count--) {
+            *internal_node_cell(left, left_count) = *internal_node_right_child(left);
+            *internal_node_key(left, left_count) = *internal_node_max_key(left);
+            *internal_node_right_child(left) = *internal_node_cell(right, 0);
+            *internal_node_max_key(left) = *internal_node_key(right, 0);
+            memmove(internal_node_cell(right, 0), internal_node_cell(right, 1),
+                (right_count - 1) * INTERNAL_NODE_CELL_SIZE);
+
+            reparent_node(pager, *internal_node_right_child(left), left_page_num);
+        }
+        for (; right_count + 1 < left_count; left_count--, right_count++) {
+            memmove(internal_node_cell(right, 1), internal_node_cell(right, 0),
+                right_count * INTERNAL_NODE_CELL_SIZE);
+            *internal_node_cell(right, 0) = *internal_node_right_child(left);
+            *internal_node_key(right, 0) = *internal_node_max_key(left);
+            *internal_node_right_child(left) = *internal_node_cell(left, left_count - 1);
+            *internal_node_max_key(left) = *internal_node_key(left, left_count - 1);
+
+            reparent_node(pager, *internal_node_cell(right, 0), right_page_num);
+        }
+
+        *internal_node_num_keys(left) = left_count;
+        *internal_node_num_keys(right) = right_count;
+    }
+
+    *internal_node_key(parent, index) = get_node_max_key(left);
+    pager_mark_dirty(pager, left_page_num);
+    pager_mark_dirty(pager, right_page_num);
+    pager_mark_dirty(pager, parent_page_num);
+
+    pager_unpin(pager, right_page_num);
+    pager_unpin(pager, left_page_num);
+    pager_unpin(pager, parent_page_num);
+}
+
+/*
+    a root that's down to one child hands the root page over to it, the root
+    has to stay where the header says it is. the tree gets a level shorter
+*/
+void collapse_root(table_t* t)
+{
+    pager_t* pager = t->pager;
+    void *root, *child;
+    u64 child_page_num;
+    u32 i;
+
+    root = pager_pin(pager, t->root_page_num);
+    child_page_num = *internal_node_right_child(root);
+    child = pager_pin(pager, child_page_num);
+
+    memcpy(root, child, PAGE_SIZE);
+    set_node_root(root, true);
+    if (get_node_type(root) == NODE_INTERNAL) {
+        for (i = 0; i <= *internal_node_num_keys(root); ++i) {
+            reparent_node(pager, *internal_node_left_child(root, i), t->root_page_num);
+        }
+    }
+    pager_mark_dirty(pager, t->root_page_num);
+
+    pager->header.tree_height--;
+    pager->header_dirty = true;
+
+    pager_unpin(pager, child_page_num);
+    pager_unpin(pager, t->root_page_num);
+
+    pager_free_page(pager, child_page_num);
+}
+
+void reparent_node(pager_t* pager, u64 page_num, u64 parent_page_num)
+{
+    *node_parent(get_page(pager, page_num)) = parent_page_num;
+    pager_mark_dirty(pager, page_num);
+}
+
+// e n d  o f  B - t r e e
+
+table_t* db_open(const char* fname, db_options_t* opts)
+{
+    table_t* table;
+    pager_t* pager;
+    void* root_node;
+
+    pager = pager_open(fname, opts);
+    table = xmalloc(sizeof(table_t));
+    table->pager = pager;
+    table->root_page_num = pager->header.root_page;
+    table->fname = fname, table->opts = opts;
+
+    if (pager->header.root_page) {
+        return table;
+    }
+
+    /*
+        new db file. the header goes to disk before anything else does, the
+        first page allocated reserves a whole extent of zeros and a file that
+        starts with one of those reads as corrupt. it has no root page yet, a
+        session that ends before the tree is written gets one here next time
+    */
+    if (!pager->num_pages) {
+        pager_init_header(pager);
+        pager_flush_header(pager);
+    }
+    table->root_page_num = get_unused_page_num(pager);
+    pager->header.root_page = table->root_page_num;
+    root_node = get_page(pager, table->root_page_num);
+    init_leaf_node(root_node);
+    set_node_root(root_node, true);
+    pager_mark_dirty(pager, table->root_page_num);
+
+    return table;
+}
+
+void db_close(table_t* t)
+{
+    pager_close(t->pager);
+    xfree(t);
+}
+
+// V A C U U M
+/*
+    works out the shape of a tree holding "num_rows" rows with at most
+    "leaf_fill" of them per leaf. the pager has to be empty, the tree's pages
+    are handed out by the builder and not by get_unused_page_num()
+*/
+void tree_builder_init(tree_builder_t* b, pager_t* pager, u64 num_rows, u32 leaf_fill)
+{
+    tree_level_t* level;
+    u64 num_items, per_node, page_num;
+    u32 i;
+
+    b->pager = pager, b->num_levels = 0, b->last_key = 0;
+
+    // keep adding levels on top until one of them fits in a single node
+    num_items = num_rows, per_node = leaf_fill;
+    do {
+        level = &b->levels[b->num_levels++];
+        level->num_items = num_items;
+        level->num_nodes = num_items ? (num_items + per_node - 1) / per_node : 1;
+        level->items_added = 0;
+
+        num_items = level->num_nodes, per_node = pager->internal_max_keys + 1;
+    } while (level->num_nodes > 1);
+
+    // root first, leaves last
+    for (i = b->num_levels, page_num = 1; i--;) {
+        b->levels[i].first_page = page_num;
+        page_num += b->levels[i].num_nodes;
+    }
+}
+
+/*
+    items are spread evenly over a level's nodes: the first
+    "num_items % num_nodes" of them take one more than the rest
+*/
+u64 tree_level_node(tree_level_t* level, u64 item)
+{
+    u64 per_node, num_bigger;
+
+    per_node = level->num_items / level->num_nodes;
+    num_bigger = level->num_items % level->num_nodes;
+    if (item < num_bigger * (per_node + 1)) {
+        return item / (per_node + 1);
+    }
+
+    return num_bigger + (item - num_bigger * (per_node + 1)) / per_node;
+}
+
+u64 tree_level_first_item(tree_level_t* level, u64 node)
+{
+    u64 per_node, num_bigger;
+
+    per_node = level->num_items / level->num_nodes;
+    num_bigger = level->num_items % level->num_nodes;
+
+    return node * per_node + (node < num_bigger ? node : num_bigger);
+}
+
+// page of the node one level up that "node" hangs off, 0 for the root
+u64 tree_builder_parent(tree_builder_t* b, u32 level, u64 node)
+{
+    tree_level_t* parent_level;
+
+    if (level + 1 == b->num_levels) {
+        return 0;
+    }
+    parent_level = &b->levels[level + 1];
+
+    return parent_level->first_page + tree_level_node(parent_level, node);
+}
+
+/*
+    appends a row to the tree. it has to have a bigger key than the row before
+    it, returns -1 when it doesn't or there's already "num_rows" rows
+*/
+int tree_builder_add(tree_builder_t* b, u32 key, void* value)
+{
+    tree_level_t* leaves = &b->levels[0];
+    u64 node, first, page_num;
+    u32 slot, count;
+    void* page;
+
+    if (leaves->items_added == leaves->num_items
+        || (leaves->items_added && key <= b->last_key)) {
+        return -1;
+    }
+
+    node = tree_level_node(leaves, leaves->items_added);
+    first = tree_level_first_item(leaves, node);
+    slot = leaves->items_added - first;
+    count = tree_level_first_item(leaves, node + 1) - first;
+    page_num = leaves->first_page + node;
+
+    page = get_page(b->pager, page_num);
+    if (slot == 0) {
+        init_leaf_node(page);
+        set_node_root(page, b->num_levels == 1);
+        *node_parent(page) = tree_builder_parent(b, 0, node);
+        *leaf_node_next_leaf(page) = node + 1 == leaves->num_nodes ? NO_SIBLING : page_num + 1;
+    }
+    *leaf_node_key(page, slot) = key;
+    memcpy(leaf_node_value(page, slot), value, LEAF_NODE_VALUE_SIZE);
+    *leaf_node_num_cells(page) = slot + 1;
+    pager_mark_dirty(b->pager, page_num);
+
+    leaves->items_added++, b->last_key = key;
+
+    // the leaf is full, its parent can point at it now
+    if (slot + 1 == count) {
+        tree_builder_push(b, 1, page_num, key);
+    }
+
+    return 0;
 }
 
-void internal_node_split_and_insert(table_t* t, u32 parent_page_num, u32 child_page_num)
+/*
+    hands a finished node over to its parent at "level". when that fills the
+    parent up it's finished too and goes up another level, and so on. a
+    node's max key is its last child's, so it's passed along as is
+*/
+void tree_builder_push(tree_builder_t* b, u32 level, u64 child_page_num, u32 max_key)
 {
-    void *parent, *child, *new_node, *old_node, *dest, *src, *curr_node;
-    u32 old_page_num, old_max, child_max, new_max, new_page_num, *old_num_keys,
-        curr_page_num, destination_page_num, max_after_split;
-    bool root_splitting;
-    int mid, i;
-
-    old_page_num = parent_page_num;
-    old_node = get_page(t->pager, parent_page_num);
-    old_max = get_node_max_key(t->pager, old_node);
+    tree_level_t* lv;
+    u64 node, first, page_num;
+    u32 slot, count;
+    void* page;
 
-    child = get_page(t->pager, child_page_num);
-    child_max = get_node_max_key(t->pager, child);
+    for (; level != b->num_levels; ++level) {
+        lv = &b->levels[level];
+        node = tree_level_node(lv, lv->items_added);
+        first = tree_level_first_item(lv, node);
+        slot = lv->items_added - first;
+        count = tree_level_first_item(lv, node + 1) - first;
+        page_num = lv->first_page + node;
+
+        page = get_page(b->pager, page_num);
+        if (slot == 0) {
+            init_internal_node(page);
+            set_node_root(page, level + 1 == b->num_levels);
+            *node_parent(page) = tree_builder_parent(b, level, node);
+            *internal_node_num_keys(page) = count - 1;
+        }
+        if (slot + 1 != count) {
+            *internal_node_left_child(page, slot) = child_page_num;
+            *internal_node_key(page, slot) = max_key;
+        } else {
+            *internal_node_right_child(page) = child_page_num;
+        }
+        *internal_node_max_key(page) = max_key;
+        pager_mark_dirty(b->pager, page_num);
+        lv->items_added++;
 
-    new_page_num = get_unused_page_num(t->pager);
+        if (slot + 1 != count) {
+            return;
+        }
+        child_page_num = page_num;
+    }
+}
 
-    /*
-        setting a flag to check if we're splitting the root node
-        just before updating pointers will allow us:
-        1.  to insert the new node during creation of the new root node if and
-            only if the root is being split.
-        2.  Otherwise, we'd have to insert the new node into its parent after
-            the old node's keys have been moved over.
-            We're not able to do this if the newly created node's parent is not
-            a newly initialized root node, because in that case, the parent may
-            have existing keys aside from our old node which we are splitting.
-            if that's true, we've to find a place to insert the new node in its
-            parent node and we can't insert it at the correct position if it
-            does not yet have any keys.
-    */
-    root_splitting = is_node_root(old_node);
+/*
+    points the header at the new tree. returns -1 if fewer rows came in than
+    the builder was told about
+*/
+int tree_builder_finish(tree_builder_t* b)
+{
+    tree_level_t* root = &b->levels[b->num_levels - 1];
+    pager_t* pager = b->pager;
+    void* page;
 
-    if (root_splitting) {
-        create_new_root(t, new_page_num);
-        parent = get_page(t->pager, t->root_page_num);
-
-        /*
-            If we're splitting the root, we'd need to update the old_node
-            to point to the new root's left child, new_page_num will already
-            be pointing to the new root's right child cuz to the call to
-            create_new_root() above.
-        */
-        old_page_num = *internal_node_left_child(parent, 0);
-        old_node = get_page(t->pager, old_page_num);
-    } else {
-        // find old node's parent first
-        u32 old_node_parent_pg_num = *node_parent(old_node);
+    if (b->levels[0].items_added != b->levels[0].num_items) {
+        return -1;
+    }
 
-        parent = get_page(t->pager, old_node_parent_pg_num);
-        new_node = get_page(t->pager, new_page_num);
-        init_internal_node(new_node);
+    // no rows at all, the root is an empty leaf
+    if (!b->levels[0].num_items) {
+        page = get_page(pager, root->first_page);
+        init_leaf_node(page);
+        set_node_root(page, true);
+        pager_mark_dirty(pager, root->first_page);
     }
 
-    old_num_keys = internal_node_num_keys(old_node);
+    pager->header.root_page = root->first_page;
+    pager->header.tree_height = b->num_levels;
+    pager->header.num_rows = b->levels[0].num_items;
+    pager->header_dirty = true;
 
-    curr_page_num = *internal_node_right_child(old_node);
-    curr_node = get_page(t->pager, curr_page_num);
+    return 0;
+}
 
-    /*
-        first put the right child of old_node into new_node and set
-        right child of old_node to INVALID_PAGE_NUM
-    */
-    internal_node_insert(t, new_page_num, curr_page_num);
-    *node_parent(curr_node) = new_page_num;
-    *internal_node_right_child(old_node) = INVALID_PAGE_NUM;
+/*
+    rebuilds the table into "<db file>-rebuild" and swaps it in for the db
+    file. the table's rows are streamed over in key order, merged with
+    "num_rows" new ones taken from "rows" in the order "order" gives( see
+    db_bulk_load() ), into a tree with "leaf_fill" rows per leaf and the
+    leaves one after the other on disk. the half empty nodes splits leave
+    behind and whatever was on the freelist are gone.
+
+    the new file is synced before it's renamed over the old one, so a crash
+    leaves one or the other behind, never a mix of both. returns the new
+    file's page count, or 0 if the keys didn't come in strictly increasing
+    and the db was left as it was
+*/
+u64 db_rebuild(table_t* t, row_t* rows, u64* order, u64 num_rows, u32 leaf_fill)
+{
+    pager_t *old_pager, *new_pager;
+    tree_builder_t builder;
+    db_options_t opts;
+    cursor_t* c;
+    char* tmp_path;
+    u8 value[sizeof(row_t)];
+    u64 i, new_num_pages;
+    u32 key;
+    void* node;
+    int result;
 
-    /*
-        for each key of old_node until u get to the middle key( without the
-        right child's key ), move the key and child to the new_node
-    */
-    i = INTERNAL_NODE_MAX_KEYS - 1;
-    mid = INTERNAL_NODE_MAX_KEYS / 2;
-    while (i != mid) {
-        curr_page_num = *internal_node_left_child(old_node, i);
-        curr_node = get_page(t->pager, curr_page_num);
+    old_pager = t->pager;
+
+    tmp_path = xmalloc(strlen(t->fname) + sizeof("-rebuild"));
+    sprintf(tmp_path, "%s-rebuild", t->fname);
+    unlink(tmp_path);
+
+    // the copy is written once and synced on close, it doesn't need a log
+    opts = *t->opts;
+    opts.mode = PAGER_MODE_BUFFERED;
+    opts.wal = false, opts.warm_start = false, opts.direct = false;
+    opts.page_size = PAGE_SIZE;
+    opts.compress = (old_pager->header.flags & DB_FLAG_COMPRESSED) != 0;
+    opts.internal_max_keys = old_pager->internal_max_keys;
+    new_pager = pager_open(tmp_path, &opts);
+    pager_init_header(new_pager);
+
+    tree_builder_init(&builder, new_pager, old_pager->header.num_rows + num_rows, leaf_fill);
+    for (c = table_start(t), i = 0, result = 0; result == 0;) {
+        if (!c->end_of_table) {
+            node = get_page(old_pager, c->page_num);
+            key = *leaf_node_key(node, c->cell_num);
+        }
 
-        internal_node_insert(t, new_page_num, curr_page_num);
-        *node_parent(curr_node) = new_page_num;
+        // whichever of the two has the smaller key goes next
+        if (i != num_rows && (c->end_of_table || (u32)(order[i] >> 32) <= key)) {
+            serialize_row(&rows[(u32)order[i]], value);
+            result = tree_builder_add(&builder, (u32)(order[i] >> 32), value);
+            i++;
+        } else if (!c->end_of_table) {
+            result = tree_builder_add(&builder, key, leaf_node_value(node, c->cell_num));
+            cursor_advance(c);
+        } else {
+            break;
+        }
+    }
+    result = result == 0 ? tree_builder_finish(&builder) : result;
+    xfree(c);
 
-        --(*old_num_keys);
-        --i;
+    new_num_pages = new_pager->num_pages;
+    pager_close(new_pager);
+    if (result < 0) {
+        unlink(tmp_path);
+        xfree(tmp_path);
+        return 0;
     }
 
-    /*
-        set child before middle key, which is now the highest key, to be the
-        old_node's right child, and decrement the number of keys
-    */
-    *internal_node_right_child(old_node)
-        = *internal_node_left_child(old_node, *old_num_keys - 1);
-    --(*old_num_keys);
+    // checkpoints and drops the log, the db file is all there is after this
+    pager_close(old_pager);
+    if (rename(tmp_path, t->fname) < 0) {
+        printf("failed to swap in the rebuilt db file, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
 
-    /*
-        Determine which of the 2 nodes after the split should contain the child
-        to be inserted and insert the child into
-    */
-    max_after_split = get_node_max_key(t->pager, old_node);
-    destination_page_num = child_max < max_after_split ? old_page_num : new_page_num;
+    if (t->opts->sync_mode != SYNC_MODE_OFF && sync_parent_dir(t->fname) < 0) {
+        printf("failed to sync the db file's directory, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    // the pages the pool held are all in different places now
+    sprintf(tmp_path, "%s-warm", t->fname);
+    unlink(tmp_path);
+
+    t->pager = pager_open(t->fname, t->opts);
+    t->root_page_num = t->pager->header.root_page;
 
-    internal_node_insert(t, destination_page_num, child_page_num);
-    *node_parent(child) = destination_page_num;
+    xfree(tmp_path);
+    return new_num_pages;
+}
 
-    new_max = get_node_max_key(t->pager, old_node);
-    update_internal_node_key(parent, old_max, new_max);
+// rebuilds the table into a densely packed tree, see db_rebuild()
+void db_vacuum(table_t* t)
+{
+    u64 old_num_pages, new_num_pages;
 
-    if (root_splitting)
+    old_num_pages = t->pager->num_pages;
+    new_num_pages = db_rebuild(t, NULL, NULL, 0, LEAF_NODE_MAX_CELLS);
+    if (!new_num_pages) {
+        printf("rows aren't in key order or don't add up to the row count. vacuum "
+               "aborted.\n");
         return;
+    }
 
-    parent_page_num = *node_parent(old_node);
-    internal_node_insert(t, parent_page_num, new_page_num);
-    *node_parent(new_node) = parent_page_num;
+    printf("vacuumed %llu pages down to %llu.\n", (unsigned long long)old_num_pages,
+        (unsigned long long)new_num_pages);
 }
 
-// e n d  o f  B - t r e e
+// B U L K  L O A D
+// orders the (id << 32 | index) pairs db_bulk_load() sorts, by id first
+int compare_keys(const void* a, const void* b)
+{
+    u64 x = *(const u64*)a, y = *(const u64*)b;
+
+    return (x > y) - (x < y);
+}
 
-table_t* db_open(const char* fname)
+/*
+    adds "num_rows" rows to the table in one go. instead of going down the
+    tree once per row and splitting leaves as they fill up, the rows are
+    sorted and the whole tree is built bottom-up next to the old one: leaves
+    filled left to right to "fill_percent" of their capacity, then every
+    internal level in the same pass( see tree_builder_add() ). rows already in
+    the table are merged in on the way.
+
+    the rows are sorted thru (id << 32 | index) pairs so that only 8 bytes
+    move around per row. returns -1 without touching the db if an id shows up
+    twice, in "rows" or in "rows" and the table
+*/
+int db_bulk_load(table_t* t, row_t* rows, u64 num_rows, u32 fill_percent)
 {
-    table_t* table;
-    pager_t* pager;
-    void* root_node;
+    u64* order;
+    u64 i;
+    u32 leaf_fill;
+    int result;
 
-    pager = pager_open(fname);
-    table = xmalloc(sizeof(table_t));
-    table->pager = pager;
-    table->root_page_num = 0x0;
+    if (num_rows > UINT32_MAX) {
+        return -1;
+    }
 
-    // new db file. initialize page 0 as leaf node
-    if (pager->num_pages == 0) {
-        root_node = get_page(pager, 0x0);
-        init_leaf_node(root_node);
-        set_node_root(root_node, true);
+    order = num_rows ? xmemalign(sizeof(u64), num_rows * sizeof(u64)) : NULL;
+    for (i = 0; i != num_rows; ++i) {
+        order[i] = (u64)rows[i].id << 32 | i;
     }
+    qsort(order, num_rows, sizeof(u64), compare_keys);
 
-    return table;
+    for (i = 1, result = 0; i < num_rows; ++i) {
+        if (order[i] >> 32 == order[i - 1] >> 32) {
+            result = -1;
+            goto cleanup;
+        }
+    }
+
+    leaf_fill = LEAF_NODE_MAX_CELLS * fill_percent / 100;
+    leaf_fill = leaf_fill ? leaf_fill : 1;
+    if (!db_rebuild(t, rows, order, num_rows, leaf_fill)) {
+        result = -1;
+    }
+
+cleanup:
+    free_mem(order);
+    return result;
 }
 
-void db_close(table_t* t)
+/*
+    ".load <file> [fill %]" bulk-loads the rows in "<file>", one
+    "<id> <username> <email>" per line like "insert" takes them. the file's
+    read twice, once to count the lines so the rows can go in one buffer
+*/
+meta_cmd_result_t exec_load_cmd(char* arg, table_t* t)
 {
-    pager_t* pager;
-    void* curr_page;
-    u32 i;
-    int result;
+    char *path, *fill_arg, *line, *curr_id;
+    size_t line_cap;
+    ssize_t len;
+    u64 num_lines, num_rows, old_num_rows;
+    int fill;
+    row_t* rows;
+    FILE* f;
+
+    path = strtok(arg, " ");
+    fill_arg = strtok(NULL, " ");
+    fill = fill_arg ? atoi(fill_arg) : DEFAULT_LOAD_FILL;
+    if (!path || fill < 1 || fill > 100) {
+        printf("usage: .load <file> [fill %%], fill is 1 to 100( default %d ).\n",
+            DEFAULT_LOAD_FILL);
+        return META_CMD_SUCCESS;
+    }
+
+    f = fopen(path, "r");
+    if (!f) {
+        printf("couldn't open '%s', %d.\n", path, errno);
+        return META_CMD_SUCCESS;
+    }
+
+    line = NULL, line_cap = 0;
+    for (num_lines = 0; getline(&line, &line_cap, f) >= 0; ++num_lines) { }
+    rewind(f);
+
+    rows = num_lines ? xmemalign(sizeof(u64), num_lines * sizeof(row_t)) : NULL;
+    for (num_lines = 0, num_rows = 0; (len = getline(&line, &line_cap, f)) >= 0;) {
+        num_lines++;
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
 
-    pager = t->pager;
-    for (i = 0; i != pager->num_pages; ++i) {
-        curr_page = pager->pages[i];
-        if (curr_page) {
-            pager_flush(pager, i);
-            xfree(curr_page);
+        curr_id = strtok(line, " ");
+        if (!curr_id) {
+            continue; // blank line
+        }
+        if (prepare_row(curr_id, &rows[num_rows++]) != PREPARE_SUCCESS) {
+            printf("line %llu of '%s' isn't an '<id> <username> <email>' row. load "
+                   "aborted.\n",
+                (unsigned long long)num_lines, path);
+            goto cleanup;
         }
     }
 
-    result = close(pager->fd);
-    if (result < 0) {
-        printf("error closing database.\n");
-        exit(EXIT_FAILURE);
+    old_num_rows = t->pager->header.num_rows;
+    if (db_bulk_load(t, rows, num_rows, fill) < 0) {
+        printf("ids have to be unique, in the file and in the table. load aborted.\n");
+        goto cleanup;
     }
 
-    xfree(pager);
-    xfree(t);
+    printf("loaded %llu rows, the table has %llu rows in %llu pages now.\n",
+        (unsigned long long)num_rows,
+        (unsigned long long)(old_num_rows + num_rows),
+        (unsigned long long)t->pager->num_pages);
+
+cleanup:
+    free_mem(line);
+    free_mem(rows);
+    fclose(f);
+    return META_CMD_SUCCESS;
+}
+
+// a rename only sticks once the directory it happened in is synced
+int sync_parent_dir(const char* path)
+{
+    char *dir_path, *slash;
+    int dir_fd, result;
+
+    dir_path = xmalloc(strlen(path) + sizeof("."));
+    strcpy(dir_path, path);
+    slash = strrchr(dir_path, '/');
+    if (!slash) {
+        strcpy(dir_path, ".");
+    } else if (slash == dir_path) {
+        slash[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+
+    dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    xfree(dir_path);
+    if (dir_fd < 0) {
+        return -1;
+    }
+    result = fsync(dir_fd);
+    close(dir_fd);
+
+    return result;
 }
 
 input_buffer_t* new_input_buffer(void)
@@ -976,14 +4568,83 @@ u8 str_exactly_equal(const char* s1, const char* s2)
     return len1 == len2 && (strncmp(s1, s2, len1) == 0);
 }
 
+/*
+    ".sync" prints the sync mode, ".sync <mode>" switches to it:
+      - off: nothing is ever fsynced, a power cut can lose or corrupt anything
+      - normal: the log is fsynced before it's checkpointed, a power cut can
+        lose the last commits but never corrupts the db
+      - full: the log is fsynced at every commit, a statement is on disk
+        before it's acknowledged
+*/
+meta_cmd_result_t exec_sync_cmd(const char* arg, pager_t* pager)
+{
+    sync_mode_t mode;
+
+    while (*arg == ' ') {
+        arg++;
+    }
+
+    if (!*arg) {
+        printf("sync: %s\n", sync_mode_name(pager->sync_mode));
+        return META_CMD_SUCCESS;
+    }
+    if (parse_sync_mode(arg, &mode) < 0) {
+        printf("sync mode must be off, normal or full.\n");
+        return META_CMD_SUCCESS;
+    }
+
+    if (pager_set_sync_mode(pager, mode) < 0) {
+        printf("failed to sync the write-ahead log, %d.\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    return META_CMD_SUCCESS;
+}
+
+/*
+    ".backup <file>" starts copying the db into "file" while the shell keeps
+    going. it's copied a few pages at a time in between statements and
+    whenever the shell is waiting for input, exiting finishes it
+*/
+meta_cmd_result_t exec_backup_cmd(const char* arg, table_t* t)
+{
+    while (*arg == ' ') {
+        arg++;
+    }
+
+    if (!*arg) {
+        printf("usage: .backup <file>\n");
+        return META_CMD_SUCCESS;
+    }
+    if (t->pager->backup) {
+        printf("a backup to '%s' is already running.\n", t->pager->backup->path);
+        return META_CMD_SUCCESS;
+    }
+    if (str_exactly_equal(arg, t->fname)) {
+        printf("can't back up the db onto itself.\n");
+        return META_CMD_SUCCESS;
+    }
+    if (pager_backup_start(t->pager, arg) < 0) {
+        printf("unable to create backup file, %d.\n", errno);
+    }
+
+    return META_CMD_SUCCESS;
+}
+
 void print_help(void)
 {
     // SQL commands
     printf("SQL commands supported:\n");
     printf("\tinsert <id> <username> <email> insert a new row into the "
            "database. That is the currently supported schema.\n");
+    printf("\tinsert or replace <id> <username> <email> insert a row, "
+           "overwriting the one with that id if there is one.\n");
+    printf("\tupdate <id> <username> <email> overwrite the row with that id.\n");
     printf("\tselect                         select all rows from the "
            "database.\n");
+    printf("\tselect count(*)                count the rows in the database.\n");
+    printf("\tdelete where id = <id>         delete the row with that id, or a "
+           "range of them with\n\t\t\t\t       delete where id between <first> and "
+           "<last>. \"from <table>\"\n\t\t\t\t       may come before \"where\".\n");
     printf("\n\tNOTE: all SQL commands should be in lower case.\n\n");
 
     // meta commands
@@ -993,7 +4654,21 @@ void print_help(void)
            "database.\n");
     printf("\t.constants print the constants to help understand the db file "
            "format and debugging purposes.\n");
+    printf("\t.header    print the db file header: page size, root page, row count "
+           "and tree height.\n");
+    printf("\t.stats     print buffer pool usage, including how many pages are "
+           "waiting to be written back.\n");
+    printf("\t.sync      print the sync mode, or set it with .sync off|normal|full.\n");
+    printf("\t.check     read every page back from disk and check its checksum.\n");
+    printf("\t.backup    copy the db into a file while it's in use, with .backup "
+           "<file>.\n");
+    printf("\t.vacuum    rebuild the table into a densely packed tree, giving back "
+           "the space splits and frees left behind.\n");
+    printf("\t.load      bulk-load the '<id> <username> <email>' rows in a file, with "
+           ".load <file> [fill %%].\n");
     printf("\t.help      print this help message.\n");
+    printf("\t--compress stores pages in whole %d byte blocks, %d byte pages can't shrink.\n",
+        SLOT_BLOCK_SIZE, SLOT_BLOCK_SIZE);
 }
 
 meta_cmd_result_t exec_meta_cmd(input_buffer_t* in, table_t* t)
@@ -1004,12 +4679,32 @@ meta_cmd_result_t exec_meta_cmd(input_buffer_t* in, table_t* t)
         exit(EXIT_SUCCESS);
     } else if (str_exactly_equal(in->buf, ".btree")) {
         printf("tree:\n");
-        print_tree(t->pager, 0, 0);
+        print_tree(t->pager, t->root_page_num, 0);
         return META_CMD_SUCCESS;
     } else if (str_exactly_equal(in->buf, ".constants")) {
         printf("constants:\n");
         print_constants();
         return META_CMD_SUCCESS;
+    } else if (str_exactly_equal(in->buf, ".header")) {
+        printf("header:\n");
+        print_header(t->pager);
+        return META_CMD_SUCCESS;
+    } else if (str_exactly_equal(in->buf, ".stats")) {
+        printf("pager:\n");
+        print_pager_stats(t->pager);
+        return META_CMD_SUCCESS;
+    } else if (str_exactly_equal(in->buf, ".check")) {
+        pager_check(t->pager);
+        return META_CMD_SUCCESS;
+    } else if (str_exactly_equal(in->buf, ".vacuum")) {
+        db_vacuum(t);
+        return META_CMD_SUCCESS;
+    } else if (!strncmp(in->buf, ".sync", 5) && (!in->buf[5] || in->buf[5] == ' ')) {
+        return exec_sync_cmd(in->buf + 5, t->pager);
+    } else if (!strncmp(in->buf, ".backup", 7) && (!in->buf[7] || in->buf[7] == ' ')) {
+        return exec_backup_cmd(in->buf + 7, t);
+    } else if (!strncmp(in->buf, ".load", 5) && (!in->buf[5] || in->buf[5] == ' ')) {
+        return exec_load_cmd(in->buf + 5, t);
     } else if (str_exactly_equal(in->buf, ".help")) {
         print_help();
         return META_CMD_SUCCESS;
@@ -1020,13 +4715,45 @@ meta_cmd_result_t exec_meta_cmd(input_buffer_t* in, table_t* t)
 
 prepare_result_t prepare_insert(input_buffer_t* in, statement* st)
 {
-    int id;
-    char *keyword, *curr_id, *username, *email;
+    char *curr_id, *replace;
 
     st->type = STATEMENT_INSERT;
+    st->or_replace = false;
+
+    strtok(in->buf, " ");
+    curr_id = strtok(NULL, " ");
+    if (curr_id && !strcmp(curr_id, "or")) {
+        replace = strtok(NULL, " ");
+        if (!replace || strcmp(replace, "replace")) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+
+        st->or_replace = true;
+        curr_id = strtok(NULL, " ");
+    }
+
+    return prepare_row(curr_id, &st->row_to_insert);
+}
+
+prepare_result_t prepare_update(input_buffer_t* in, statement* st)
+{
+    char* curr_id;
+
+    st->type = STATEMENT_UPDATE;
 
-    keyword = strtok(in->buf, " ");
+    strtok(in->buf, " ");
     curr_id = strtok(NULL, " ");
+
+    return prepare_row(curr_id, &st->row_to_insert);
+}
+
+// the "<id> <username> <email>" part of a statement, strtok() is already
+// past whatever came before the id
+prepare_result_t prepare_row(char* curr_id, row_t* r)
+{
+    int id;
+    char *username, *email;
+
     username = strtok(NULL, " ");
     email = strtok(NULL, " ");
     if (!curr_id || !username || !email) {
@@ -1044,8 +4771,54 @@ prepare_result_t prepare_insert(input_buffer_t* in, statement* st)
         return PREPARE_STRING_TOO_LONG;
     }
 
-    st->row_to_insert.id = id, strcpy(st->row_to_insert.username, username),
-    strcpy(st->row_to_insert.email, email);
+    r->id = id, strcpy(r->username, username), strcpy(r->email, email);
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+        delete [from <table>] where id = <id>
+        delete [from <table>] where id between <first> and <last>
+    there's only the one table, so the "from" part is optional and whatever
+    table it names is that one
+*/
+prepare_result_t prepare_delete(input_buffer_t* in, statement* st)
+{
+    int first_id, last_id;
+    char *where, *column, *op, *first, *and, *last;
+
+    st->type = STATEMENT_DELETE;
+
+    strtok(in->buf, " ");
+    where = strtok(NULL, " ");
+    if (where && !strcmp(where, "from")) {
+        if (!strtok(NULL, " ")) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        where = strtok(NULL, " ");
+    }
+    column = strtok(NULL, " ");
+    op = strtok(NULL, " ");
+    first = strtok(NULL, " ");
+    and = strtok(NULL, " ");
+    last = strtok(NULL, " ");
+    if (!where || strcmp(where, "where") || !column || strcmp(column, "id") || !op || !first) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    if (!strcmp(op, "=") && !and) {
+        last = first;
+    } else if (strcmp(op, "between") || !and || strcmp(and, "and") || !last
+        || strtok(NULL, " ")) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    first_id = atoi(first), last_id = atoi(last);
+    if (first_id < 0 || last_id < 0) {
+        return PREPARE_NEGATIVE_ID;
+    }
+
+    st->first_id = first_id, st->last_id = last_id;
 
     return PREPARE_SUCCESS;
 }
@@ -1054,6 +4827,9 @@ prepare_result_t prepare_statement(input_buffer_t* in, statement* st)
 {
     const char* st_insert = "insert";
     const char* st_select = "select";
+    const char* st_select_count = "select count(*)";
+    const char* st_delete = "delete";
+    const char* st_update = "update";
 
     if (!strncmp(st_insert, in->buf, strlen(st_insert))) {
         return prepare_insert(in, st);
@@ -1062,6 +4838,16 @@ prepare_result_t prepare_statement(input_buffer_t* in, statement* st)
         st->type = STATEMENT_SELECT;
         return PREPARE_SUCCESS;
     }
+    if (!strcmp(st_select_count, in->buf)) {
+        st->type = STATEMENT_SELECT_COUNT;
+        return PREPARE_SUCCESS;
+    }
+    if (!strncmp(st_delete, in->buf, strlen(st_delete))) {
+        return prepare_delete(in, st);
+    }
+    if (!strncmp(st_update, in->buf, strlen(st_update))) {
+        return prepare_update(in, st);
+    }
 
     return PREPARE_UNRECOGNIZED_STATEMENT;
 }
@@ -1074,7 +4860,7 @@ prepare_result_t prepare_statement(input_buffer_t* in, statement* st)
 */
 cursor_t* table_find(table_t* t, u32 key)
 {
-    u32 root_page_num;
+    u64 root_page_num;
     void* root_node;
 
     root_page_num = t->root_page_num;
@@ -1095,22 +4881,30 @@ execute_result_t exec_insert(statement* st, table_t* t)
     u32 num_cells, key_to_insert;
     execute_result_t result;
 
-    node = get_page(t->pager, t->root_page_num);
-    num_cells = (*leaf_node_num_cells(node));
-
     new_row = &(st->row_to_insert);
     key_to_insert = new_row->id;
 
+    // the key belongs in the leaf the cursor points at, not in the root
     c = table_find(t, key_to_insert);
+    node = get_page(t->pager, c->page_num);
+    num_cells = (*leaf_node_num_cells(node));
     if (c->cell_num < num_cells) {
         u32 key_at_index = *leaf_node_key(node, c->cell_num);
         if (key_at_index == key_to_insert) {
             result = EXECUTE_DUPLICATE_KEY;
+            if (st->or_replace) {
+                // the cursor's already on the row, no need to go down again
+                serialize_row(new_row, leaf_node_value(node, c->cell_num));
+                pager_mark_dirty(t->pager, c->page_num);
+                result = EXECUTE_SUCCESS;
+            }
             goto cleanup;
         }
     }
 
     leaf_node_insert(c, new_row->id, new_row);
+    t->pager->header.num_rows++;
+    t->pager->header_dirty = true;
     result = EXECUTE_SUCCESS;
 
 cleanup:
@@ -1118,6 +4912,30 @@ cleanup:
     return result;
 }
 
+// the row's rewritten where it is, the key and the tree stay as they are
+execute_result_t exec_update(statement* st, table_t* t)
+{
+    void* node;
+    cursor_t* c;
+    row_t* new_row;
+    execute_result_t result;
+
+    new_row = &(st->row_to_insert);
+
+    c = table_find(t, new_row->id);
+    node = get_page(t->pager, c->page_num);
+    result = EXECUTE_KEY_NOT_FOUND;
+    if (c->cell_num < *leaf_node_num_cells(node)
+        && *leaf_node_key(node, c->cell_num) == new_row->id) {
+        serialize_row(new_row, leaf_node_value(node, c->cell_num));
+        pager_mark_dirty(t->pager, c->page_num);
+        result = EXECUTE_SUCCESS;
+    }
+
+    xfree(c);
+    return result;
+}
+
 execute_result_t exec_select(statement* st, table_t* t)
 {
     row_t r;
@@ -1133,6 +4951,81 @@ execute_result_t exec_select(statement* st, table_t* t)
     return EXECUTE_SUCCESS;
 }
 
+/*
+    deletes the rows with keys "first" thru "last" and returns how many there
+    were. the cursor walks the leaf chain and the rows a leaf holds in the
+    range are cut out of it in one go. only a leaf that gets rebalanced sends
+    the cursor back to the root, merging it moves rows between leaves
+*/
+u32 table_delete_range(table_t* t, u32 first, u32 last)
+{
+    pager_t* pager = t->pager;
+    cursor_t* c;
+    void* node;
+    u64 next_page_num;
+    u32 end, count, num_cells, resume, deleted;
+    bool more, rebalanced;
+
+    deleted = 0, resume = first;
+    c = table_find(t, first);
+    while (1) {
+        node = get_page(pager, c->page_num);
+        num_cells = *leaf_node_num_cells(node);
+        for (end = c->cell_num; end < num_cells && *leaf_node_key(node, end) <= last; ++end) { }
+
+        // the range may go on in the next leaf if it ran up to the end of this one
+        more = end == num_cells && !is_last_leaf_node(node);
+        next_page_num = *leaf_node_next_leaf(node);
+        rebalanced = false;
+        if (end > c->cell_num) {
+            count = end - c->cell_num;
+            more = more && *leaf_node_key(node, end - 1) != last;
+            resume = *leaf_node_key(node, end - 1) + 1;
+            rebalanced = !is_node_root(node) && num_cells - count < LEAF_NODE_MIN_CELLS;
+
+            leaf_node_delete(c, count);
+            deleted += count;
+        }
+        if (!more) {
+            break;
+        }
+
+        if (rebalanced) {
+            xfree(c);
+            c = table_find(t, resume);
+        } else {
+            c->page_num = next_page_num, c->cell_num = 0;
+        }
+    }
+
+    if (deleted) {
+        pager->header.num_rows -= deleted;
+        pager->header_dirty = true;
+    }
+
+    xfree(c);
+    return deleted;
+}
+
+// like update, a single id that isn't there is an error. a range that's
+// empty isn't
+execute_result_t exec_delete(statement* st, table_t* t)
+{
+    if (!table_delete_range(t, st->first_id, st->last_id) && st->first_id == st->last_id) {
+        return EXECUTE_KEY_NOT_FOUND;
+    }
+
+    return EXECUTE_SUCCESS;
+}
+
+// the header keeps a running row count, no need to touch the tree
+execute_result_t exec_select_count(statement* st, table_t* t)
+{
+    printf("( %llu )\n", t->pager->header.num_rows);
+
+    return EXECUTE_SUCCESS;
+}
+
 execute_result_t exec_statement(statement* st, table_t* t)
 {
     switch (st->type) {
@@ -1140,11 +5033,30 @@ execute_result_t exec_statement(statement* st, table_t* t)
         return exec_insert(st, t);
     case STATEMENT_SELECT:
         return exec_select(st, t);
+    case STATEMENT_SELECT_COUNT:
+        return exec_select_count(st, t);
+    case STATEMENT_DELETE:
+        return exec_delete(st, t);
+    case STATEMENT_UPDATE:
+        return exec_update(st, t);
     }
 }
 
 void print_prompt(void) { printf("lyt-db> "); }
 
+/*
+    tells if there's more input waiting on stdin. lines stdio already pulled
+    into its buffer don't show up, so this can say no when the next line is
+    in fact there. that only lets a running backup take a few more steps
+*/
+bool input_pending(void)
+{
+    struct pollfd pfd;
+
+    pfd.fd = STDIN_FILENO, pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
 int read_input(input_buffer_t* in)
 {
     ssize_t bytes_read;
@@ -1154,10 +5066,11 @@ int read_input(input_buffer_t* in)
         return -1;
     }
 
-    in->input_len = bytes_read - 1;
-
-    // remove trailing new-line feed
-    in->buf[bytes_read - 1] = '\0';
+    // remove trailing new-line feed, the last line of input might not have one
+    if (in->buf[bytes_read - 1] == '\n') {
+        in->buf[--bytes_read] = '\0';
+    }
+    in->input_len = bytes_read;
 
     return 0;
 }
@@ -1171,16 +5084,25 @@ void close_input_buffer(input_buffer_t* in)
     xfree(in);
 }
 
-void run_repl(const char* fname)
+void run_repl(const char* fname, db_options_t* opts)
 {
     char* err_msg = NULL;
 
-    table_t* table = db_open(fname);
+    table_t* table = db_open(fname, opts);
     input_buffer_t* user_input = new_input_buffer();
 
     // make a REPL
     do {
         print_prompt();
+
+        // a running backup gets a step after every statement and keeps going
+        // for as long as nobody's typing
+        if (table->pager->backup) {
+            fflush(stdout);
+            while (pager_backup_step(table->pager, BACKUP_STEP_PAGES) == 0
+                && !input_pending()) { }
+        }
+
         int ret = read_input(user_input);
         if (ret < 0) {
             goto cleanup;
@@ -1226,8 +5148,15 @@ void run_repl(const char* fname)
             continue;
         }
 
-        // execute the statement
-        switch (exec_statement(&st, table)) {
+        // execute the statement. it isn't done before its commit is, in full
+        // sync mode that means it's on disk
+        execute_result_t res = exec_statement(&st, table);
+        if (pager_commit(table->pager) < 0) {
+            printf("error: failed to commit, %d. the statement may be lost.\n", errno);
+            exit(EXIT_FAILURE);
+        }
+
+        switch (res) {
         case EXECUTE_SUCCESS:
             printf("executed.\n");
             break;
@@ -1237,9 +5166,20 @@ void run_repl(const char* fname)
         case EXECUTE_DUPLICATE_KEY:
             printf("error: duplicate key.\n");
             break;
+        case EXECUTE_KEY_NOT_FOUND:
+            printf("error: no row with that id.\n");
+            break;
         }
     } while (1);
 
 cleanup:
+    // input ran out without an ".exit". whatever was committed is already
+    // safe in the log and gets replayed on the next open, just make sure the
+    // checkpointer isn't halfway thru a write when we exit
+    while (table->pager->backup && !pager_backup_step(table->pager, BACKUP_STEP_PAGES)) { }
+    if (table->pager->wal) {
+        wal_wait_checkpoint(table->pager->wal);
+    }
+    pager_save_warm_set(table->pager);
     close_input_buffer(user_input);
 }
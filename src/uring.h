@@ -0,0 +1,241 @@
+/*
+    MIT License
+
+    Copyright (c) 2024 winterrdog
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef _SQLYTE_URING_H
+#define _SQLYTE_URING_H 1
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+** A bare-bones io_uring wrapper, just enough for the pager to hand the kernel
+** a batch of page reads or writes at once and then wait for all of them.
+**
+** It talks to the kernel thru the raw syscalls so we don't need liburing.
+** On systems without io_uring every call fails with ENOSYS and the pager
+** keeps using plain synchronous I/O.
+*/
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct {
+    int fd;
+    unsigned num_entries;
+    unsigned pending; // sqes filled in but not yet handed to the kernel
+
+    // submission queue
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe* sqes;
+
+    // completion queue
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_len, cq_ring_len, sqes_len;
+} uring_t;
+
+static int uring_open(uring_t* ring, unsigned num_entries)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0x0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, num_entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->num_entries = params.sq_entries;
+    ring->pending = 0;
+    ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED
+        || ring->sqes == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_head = ring->sq_ring + params.sq_off.head;
+    ring->sq_tail = ring->sq_ring + params.sq_off.tail;
+    ring->sq_mask = ring->sq_ring + params.sq_off.ring_mask;
+    ring->sq_array = ring->sq_ring + params.sq_off.array;
+
+    ring->cq_head = ring->cq_ring + params.cq_off.head;
+    ring->cq_tail = ring->cq_ring + params.cq_off.tail;
+    ring->cq_mask = ring->cq_ring + params.cq_off.ring_mask;
+    ring->cqes = ring->cq_ring + params.cq_off.cqes;
+
+    return 0;
+}
+
+/*
+** Queues a vectored read or write. Nothing reaches the kernel until
+** uring_submit_and_wait() is called. Returns -1 when the submission queue is
+** full, in which case the caller should submit what's queued first.
+*/
+static int uring_queue_rw(uring_t* ring, int opcode, int fd, const struct iovec* iov,
+    unsigned num_iov, off_t offset, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe;
+    unsigned tail, idx;
+
+    if (ring->pending == ring->num_entries) {
+        return -1;
+    }
+
+    tail = *ring->sq_tail;
+    idx = tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+
+    memset(sqe, 0x0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = num_iov;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+
+    return 0;
+}
+
+static int uring_queue_readv(uring_t* ring, int fd, const struct iovec* iov,
+    unsigned num_iov, off_t offset, uint64_t user_data)
+{
+    return uring_queue_rw(ring, IORING_OP_READV, fd, iov, num_iov, offset, user_data);
+}
+
+static int uring_queue_writev(uring_t* ring, int fd, const struct iovec* iov,
+    unsigned num_iov, off_t offset, uint64_t user_data)
+{
+    return uring_queue_rw(ring, IORING_OP_WRITEV, fd, iov, num_iov, offset, user_data);
+}
+
+/*
+** Hands every queued request to the kernel in one syscall and waits for all of
+** them to finish. "on_complete" gets called once per request with its
+** user_data and result( bytes transferred or -errno ).
+*/
+static int uring_submit_and_wait(
+    uring_t* ring, void (*on_complete)(void* ctx, uint64_t user_data, int res), void* ctx)
+{
+    struct io_uring_cqe* cqe;
+    unsigned head, to_submit, to_reap;
+    int ret;
+
+    to_submit = ring->pending, to_reap = ring->pending;
+    while (to_submit || to_reap) {
+        ret = syscall(
+            __NR_io_uring_enter, ring->fd, to_submit, to_reap, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        to_submit -= ret;
+
+        head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &ring->cqes[head & *ring->cq_mask];
+            on_complete(ctx, cqe->user_data, cqe->res);
+
+            head++, to_reap--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    ring->pending = 0;
+    return 0;
+}
+
+static void uring_close(uring_t* ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    munmap(ring->cq_ring, ring->cq_ring_len);
+    munmap(ring->sq_ring, ring->sq_ring_len);
+    close(ring->fd);
+}
+
+#else
+
+typedef struct {
+    int fd;
+    unsigned num_entries;
+} uring_t;
+
+static int uring_open(uring_t* ring, unsigned num_entries)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int uring_queue_readv(uring_t* ring, int fd, const struct iovec* iov,
+    unsigned num_iov, off_t offset, uint64_t user_data)
+{
+    return -1;
+}
+
+static int uring_queue_writev(uring_t* ring, int fd, const struct iovec* iov,
+    unsigned num_iov, off_t offset, uint64_t user_data)
+{
+    return -1;
+}
+
+static int uring_submit_and_wait(
+    uring_t* ring, void (*on_complete)(void* ctx, uint64_t user_data, int res), void* ctx)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static void uring_close(uring_t* ring) { }
+
+#endif
+
+#endif
@@ -28,6 +28,7 @@
     - winterrdog: readapted xstrdup()
     - winterrdog: added xfree()
     - winterrdog: added xfree_all()
+    - winterrdog: added xmemalign()
 
 */
 
@@ -47,6 +48,7 @@
 // void xfree(void* p);
 // void xfree_all(void);
 // void free_mem(void* p);
+// void* xmemalign(size_t alignment, size_t size);
 // const char* xstrdup(const char* s);
 
 /*
@@ -168,6 +170,26 @@ static const char* xstrdup(const char* src)
     return (const char*)dest;
 }
 
+/*
+** Zeroed memory that starts on an "alignment" boundary, for buffers handed to
+** the kernel with O_DIRECT. It can't carry a header in front, so it's NOT on
+** the list and has to be released with free_mem().
+*/
+static void* xmemalign(size_t alignment, size_t size)
+{
+    void* new_blk;
+
+    if (size == 0) {
+        return NULL;
+    }
+    if (posix_memalign(&new_blk, alignment, size) != 0) {
+        return xmalloc_fatal(size);
+    }
+    memset(new_blk, 0x0, size);
+
+    return new_blk;
+}
+
 // make sure u free memory allocated by xmalloc, xcalloc, xrealloc
 static void xfree(void* old_blk)
 {
@@ -1,4 +1,5 @@
 const { execSync } = require("child_process");
+const fs = require("fs");
 const { log } = require("console");
 
 describe("database e2e tests", function () {
@@ -15,20 +16,20 @@ Turn on debugging with DEBUG=1 like so:
   });
 
   beforeEach(function () {
-    execSync("rm -f test.db");
+    execSync("rm -f test.db test.db-wal test.db-warm test.db-backup test.db-load");
   });
 
-  const runScript = (commands) => {
+  const runScript = (commands, args = []) => {
     let childProcess, rawOutput;
 
     try {
       let exec_cmd;
+      const argv = [...args, "test.db"].join(" ");
 
       if (process.env.DEBUG === "1") {
-        exec_cmd =
-          "valgrind --leak-check=full --track-origins=yes ./sqlyte test.db";
+        exec_cmd = `valgrind --leak-check=full --track-origins=yes ./sqlyte ${argv}`;
       } else {
-        exec_cmd = "./sqlyte test.db";
+        exec_cmd = `./sqlyte ${argv}`;
       }
 
       childProcess = execSync(exec_cmd, {
@@ -58,28 +59,595 @@ Turn on debugging with DEBUG=1 like so:
     expect(result).toStrictEqual(commandsExpectedResult);
   });
 
-  it("prints error message when table's full", function () {
-    const createManyEntries = () => {
-      let i;
-      const result = [];
-      const maxTableRows = 1400;
+  it("stores more pages than the buffer pool can hold", function () {
+    const rows = 1400;
+    const commands = [];
+    const expectedRows = [];
 
-      for (i = 0; i != maxTableRows + 0x1; i++) {
-        result.push(`insert ${i} user${i} person${i}@example.com`);
-      }
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+    runScript(commands, ["--frames=64"]);
+
+    // reopen and scan the whole table thru the small pool
+    const result = runScript(["select", ".exit\n"], ["--frames=64"]);
+    expectedRows[0] = `lyt-db> ${expectedRows[0]}`;
+    expect(result).toStrictEqual([...expectedRows, "executed.", "lyt-db> "]);
+  });
+
+  it("only counts changed pages as dirty", function () {
+    runScript(["insert 1 user1 person1@example.com", ".stats", ".exit\n"]);
+
+    // reading the db back in must not leave anything to write back
+    const result = runScript(["select", ".stats", ".exit\n"]);
+    expect(result).toStrictEqual([
+      "lyt-db> ( 1, user1, person1@example.com )",
+      "executed.",
+      "lyt-db> pager:",
+      "mode: buffered",
+      "pages: 2",
+      "allocated: 2",
+      "free: 0",
+      "io: sync",
+      "frames: 1024",
+      "resident: 1",
+      "pinned: 0",
+      "read ahead: 0",
+      "dirty: 0",
+      "wal frames: 0",
+      "lyt-db> ",
+    ]);
+
+    // a finished statement leaves its changed pages in the log, not dirty.
+    // that's the leaf plus the header page with the new row count
+    const afterInsert = runScript([
+      "insert 2 user2 person2@example.com",
+      ".stats",
+      ".exit\n",
+    ]);
+    expect(afterInsert.slice(-3, -1)).toStrictEqual([
+      "dirty: 0",
+      "wal frames: 2",
+    ]);
+  });
+
+  it("grows the db file a whole extent at a time", function () {
+    const commands = [];
+
+    for (let i = 1; i != 21; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push(".stats", ".exit\n");
+
+    const result = runScript(commands, ["--extent=64"]);
+    expect(result).toContain("allocated: 64");
+
+    // the unused part of the extent is dropped on the way out
+    const stats = runScript([".stats", ".exit\n"]);
+    const pages = Number(
+      stats.find((line) => line.startsWith("pages: ")).split(": ")[1]
+    );
+    expect(stats).toContain(`allocated: ${pages}`);
+    expect(fs.statSync("test.db").size).toBe(pages * 4096);
+  });
+
+  it("keeps the row count and tree shape in the header", function () {
+    const commands = [];
+
+    for (let i = 1; i != 31; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push("insert 1 user1 person1@example.com", ".exit\n");
+    runScript(commands);
+
+    const result = runScript(["select count(*)", ".header", ".exit\n"]);
+    expect(result).toStrictEqual([
+      "lyt-db> ( 30 )",
+      "executed.",
+      "lyt-db> header:",
+      "version: 4",
+      "page size: 4096",
+      "root page: 1",
+      "pages: 6",
+      "free pages: 0",
+      "rows: 30",
+      "tree height: 2",
+      "lyt-db> ",
+    ]);
+  });
+
+  it("opens a new db whose first session ended without .exit", function () {
+    runScript([".help"]);
+    runScript([]);
+
+    const result = runScript(["insert 1 user1 person1@example.com", "select", ".exit\n"]);
+    expect(result).toStrictEqual([
+      "lyt-db> executed.",
+      "lyt-db> ( 1, user1, person1@example.com )",
+      "executed.",
+      "lyt-db> ",
+    ]);
+  });
+
+  it("keeps the page size a db file was created with", function () {
+    const rows = 200;
+    const commands = [];
+    const expectedRows = [];
+
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+    runScript(commands, ["--page-size=16384"]);
+
+    // no option needed to open it again, the header knows
+    const result = runScript(["select", ".constants", ".header", ".exit\n"]);
+    expectedRows[0] = `lyt-db> ${expectedRows[0]}`;
+    expect(result.slice(0, rows + 1)).toStrictEqual([
+      ...expectedRows,
+      "executed.",
+    ]);
+    expect(result).toContain("LEAF_NODE_SPACE_FOR_CELLS: 16358");
+    expect(result).toContain("LEAF_NODE_MAX_CELLS: 55");
+    expect(result).toContain("page size: 16384");
+    expect(result).toContain("rows: 200");
+  });
+
+  it("rejects page sizes that aren't a power of 2 in range", function () {
+    const result = runScript([".exit\n"], ["--page-size=5000"]);
+    expect(result[0]).toEqual(
+      "page size must be a power of 2 between 4096 and 65536."
+    );
+  });
 
-      result.push(".btree\n");
-      result.push(".exit\n");
-      return result;
-    };
+  it("recovers committed rows from the write-ahead log", function () {
+    const rows = 300;
+    const commands = [];
+    const expectedRows = [];
 
-    const commands = createManyEntries();
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
 
-    const commandsExpectedResult =
-      "lyt-db> tried to fetch a page out of bounds. 101 > 100";
+    // no ".exit", so the db is never closed and the rows only live in the log
+    runScript(commands, ["--frames=64"]);
+    expect(execSync("ls test.db-wal").toString()).toEqual("test.db-wal\n");
 
+    const result = runScript(["select", ".exit\n"]);
+    expectedRows[0] = `lyt-db> ${expectedRows[0]}`;
+    expect(result).toStrictEqual([...expectedRows, "executed.", "lyt-db> "]);
+
+    // a clean close folds the log back into the db file
+    expect(fs.existsSync("test.db-wal")).toBe(false);
+  });
+
+  it("catches pages that don't match their checksum", function () {
+    const commands = [];
+
+    for (let i = 1; i != 31; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push(".check", ".exit\n");
+    expect(runScript(commands)).toContain("lyt-db> pages checked: 6, corrupt: 0");
+
+    // flip a byte in the middle of page 2
+    const fd = fs.openSync("test.db", "r+");
+    const byte = Buffer.alloc(1);
+    fs.readSync(fd, byte, 0, 1, 2 * 4096 + 100);
+    byte[0] ^= 0xff;
+    fs.writeSync(fd, byte, 0, 1, 2 * 4096 + 100);
+    fs.closeSync(fd);
+
+    expect(runScript(["select", ".exit\n"])).toContain(
+      "page 2 failed its checksum. Corrupt database file."
+    );
+    expect(runScript(["select", ".exit\n"], ["--mmap"])).toContain(
+      "page 2 failed its checksum. Corrupt database file."
+    );
+
+    // only ".check" looks when told to
+    const result = runScript([".check", ".exit\n"], ["--verify=check"]);
+    expect(result).toContain("lyt-db> page 2: bad checksum");
+    expect(result).toContain("pages checked: 6, corrupt: 1");
+  });
+
+  it("compresses pages on their way to the db file", function () {
+    const rows = 500;
+    const commands = [];
+    const expectedRows = [];
+
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+
+    runScript(commands, ["--page-size=16384"]);
+    const whole = fs.statSync("test.db").blocks;
+
+    execSync("rm -f test.db test.db-wal test.db-warm");
+    runScript(commands, ["--page-size=16384", "--compress"]);
+    const compressed = fs.statSync("test.db").blocks;
+
+    // rows are mostly zero padding
+    expect(whole).toBeGreaterThan(compressed * 3);
+
+    // the db file knows it has compressed pages, no need to ask again
+    const result = runScript(["select", ".check", ".exit\n"]);
+    expect(result.slice(0, rows)).toStrictEqual([
+      `lyt-db> ${expectedRows[0]}`,
+      ...expectedRows.slice(1),
+    ]);
+    expect(result.find((line) => line.includes("pages checked: "))).toContain(
+      "corrupt: 0"
+    );
+  });
+
+  it("warns that --compress can't shrink 4096 byte pages", function () {
+    const result = runScript(["insert 1 a b", ".exit\n"], ["--compress"]);
+    expect(result[0]).toBe(
+      "--compress needs pages bigger than 4096 bytes, this db has 4096 byte pages. " +
+        "pages are stored uncompressed."
+    );
+    expect(result[1]).toBe("lyt-db> executed.");
+  });
+
+  it("packs the tree back together with .vacuum", function () {
+    const commands = [];
+    const expectedRows = [];
+
+    // every leaf split leaves 2 half full leaves behind
+    for (let i = 1; i != 301; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".vacuum", ".exit\n");
+
+    const vacuumed = runScript(commands).find((line) => line.includes("vacuumed "));
+    const [before, after] = vacuumed.match(/\d+/g).map(Number);
+    expect(before).toBeGreaterThan(after * 1.5);
+
+    const result = runScript(["select", ".header", ".check", ".exit\n"]);
+    expect(result.slice(0, 300)).toStrictEqual([
+      `lyt-db> ${expectedRows[0]}`,
+      ...expectedRows.slice(1),
+    ]);
+    expect(result).toContain(`pages: ${after}`);
+    expect(result).toContain("rows: 300");
+    expect(result.find((line) => line.includes("pages checked: "))).toContain(
+      "corrupt: 0"
+    );
+  });
+
+  it("overwrites rows in place with update and insert or replace", function () {
+    const commands = [
+      "insert 1 user1 person1@example.com",
+      "insert 2 user2 person2@example.com",
+      "update 2 bob bob@example.com",
+      "update 3 carol carol@example.com",
+      "insert or replace 1 alice alice@example.com",
+      "insert or replace 3 carol carol@example.com",
+      "insert 3 dave dave@example.com",
+      "select",
+      "select count(*)",
+      ".exit\n",
+    ];
     const result = runScript(commands);
-    expect(result.at(-2)).toEqual(commandsExpectedResult);
+    expect(result).toStrictEqual([
+      "lyt-db> executed.",
+      "lyt-db> executed.",
+      "lyt-db> executed.",
+      "lyt-db> error: no row with that id.",
+      "lyt-db> executed.",
+      "lyt-db> executed.",
+      "lyt-db> error: duplicate key.",
+      "lyt-db> ( 1, alice, alice@example.com )",
+      "( 2, bob, bob@example.com )",
+      "( 3, carol, carol@example.com )",
+      "executed.",
+      "lyt-db> ( 3 )",
+      "executed.",
+      "lyt-db> ",
+    ]);
+  });
+
+  it("deletes rows and merges the nodes they leave half empty", function () {
+    const commands = [];
+
+    for (let i = 1; i != 101; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push(
+      "delete where id = 50",
+      "delete where id = 50",
+      "delete where id between 3 and 97",
+      ".exit\n"
+    );
+    runScript(commands, ["--max-keys=3"]);
+
+    const result = runScript(
+      ["select", "select count(*)", ".header", ".exit\n"],
+      ["--max-keys=3"]
+    );
+    expect(result).toStrictEqual([
+      "lyt-db> ( 1, user1, person1@example.com )",
+      "( 2, user2, person2@example.com )",
+      "( 98, user98, person98@example.com )",
+      "( 99, user99, person99@example.com )",
+      "( 100, user100, person100@example.com )",
+      "executed.",
+      "lyt-db> ( 5 )",
+      "executed.",
+      "lyt-db> header:",
+      "version: 4",
+      "page size: 4096",
+      "root page: 1",
+      "pages: 24",
+      "free pages: 22",
+      "rows: 5",
+      "tree height: 1",
+      "lyt-db> ",
+    ]);
+  });
+
+  it("keeps the internal node cap the db was created with", function () {
+    expect(runScript([".exit\n"], ["--max-keys=339"])).toContain(
+      "--max-keys can't be more than the 338 keys that fit in a 4096 byte page."
+    );
+
+    execSync("rm -f test.db");
+    runScript(["insert 1 user1 person1@example.com", ".exit\n"], ["--max-keys=3"]);
+    expect(runScript([".exit\n"], ["--max-keys=4"])).toContain(
+      "--max-keys is set when the db is created, this one's internal nodes hold up to 3 keys."
+    );
+
+    // without the option it's the db's own cap that counts
+    const commands = [];
+    for (let i = 2; i != 101; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push(".vacuum", ".header", ".exit\n");
+    expect(runScript(commands)).toContain("tree height: 3");
+  });
+
+  it("says so when the id to delete isn't there", function () {
+    const result = runScript([
+      "insert 1 user1 person1@example.com",
+      "insert 2 user2 person2@example.com",
+      "delete from users where id = 3",
+      "delete from users where id = 2",
+      "delete where id between 5 and 9",
+      "select",
+      ".exit\n",
+    ]);
+    expect(result).toStrictEqual([
+      "lyt-db> executed.",
+      "lyt-db> executed.",
+      "lyt-db> error: no row with that id.",
+      "lyt-db> executed.",
+      "lyt-db> executed.",
+      "lyt-db> ( 1, user1, person1@example.com )",
+      "executed.",
+      "lyt-db> ",
+    ]);
+  });
+
+  it("bulk-loads rows from a file into a packed tree with .load", function () {
+    const lines = [];
+    const expectedRows = [];
+
+    // the file doesn't have to be sorted, and rows already in the table are
+    // merged in
+    for (let i = 300; i != 0; i--) {
+      if (i != 150) {
+        lines.push(`${i} user${i} person${i}@example.com`);
+      }
+    }
+    for (let i = 1; i != 301; i++) {
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    fs.writeFileSync("test.db-load", lines.join("\n") + "\n");
+
+    const loaded = runScript([
+      "insert 150 user150 person150@example.com",
+      ".load test.db-load",
+      ".load test.db-load",
+      ".exit\n",
+    ]);
+    expect(loaded).toStrictEqual([
+      "lyt-db> executed.",
+      "lyt-db> loaded 299 rows, the table has 300 rows in 26 pages now.",
+      "lyt-db> ids have to be unique, in the file and in the table. load aborted.",
+      "lyt-db> ",
+    ]);
+
+    const result = runScript(["select", ".header", ".exit\n"]);
+    expect(result.slice(0, 300)).toStrictEqual([
+      `lyt-db> ${expectedRows[0]}`,
+      ...expectedRows.slice(1),
+    ]);
+    expect(result).toContain("pages: 26");
+    expect(result).toContain("rows: 300");
+    expect(result).toContain("tree height: 2");
+  });
+
+  it("backs the db up while rows keep coming in", function () {
+    const commands = [];
+
+    for (let i = 1; i != 301; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    runScript([...commands, ".exit\n"]);
+
+    // the backup is copied a step at a time in between the inserts
+    commands.length = 0;
+    commands.push(".backup test.db-backup");
+    for (let i = 301; i != 321; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push(".exit\n");
+    const backedUp = runScript(commands).find((line) => line.includes("backed up "));
+    expect(backedUp).toContain("test.db-backup");
+    expect(fs.existsSync("test.db-backup-warm")).toBe(false);
+
+    // whatever made it in, it's all of the rows up to some point
+    execSync("rm -f test.db test.db-wal test.db-warm && mv test.db-backup test.db");
+    const result = runScript(["select", "select count(*)", ".check", ".exit\n"]);
+    const rows = result.filter((line) => line.includes("@example.com"));
+    expect(rows.length).toBeGreaterThan(299);
+    rows.forEach((line, i) => expect(line).toContain(`( ${i + 1}, user${i + 1},`));
+    expect(result).toContain(`lyt-db> ( ${rows.length} )`);
+    expect(result.find((line) => line.includes("pages checked: "))).toContain(
+      "corrupt: 0"
+    );
+  });
+
+  it("reads the pool's pages back in when reopened", function () {
+    const commands = [];
+
+    for (let i = 1; i != 201; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+    }
+    commands.push("select", ".exit\n");
+
+    // only asked for, the db doesn't get a sidecar file otherwise
+    runScript(commands);
+    expect(fs.existsSync("test.db-warm")).toBe(false);
+    execSync("rm -f test.db test.db-wal");
+    runScript(commands, ["--warm"]);
+    expect(fs.existsSync("test.db-warm")).toBe(true);
+
+    // nothing ran yet, but everything the last session had cached is back
+    const pages = runScript([".stats", ".exit\n"]).find((line) =>
+      line.startsWith("pages: ")
+    );
+    const warm = runScript([".stats", ".exit\n"], ["--warm"]);
+    expect(warm).toContain(`resident: ${pages.split(": ")[1]}`);
+
+    const cold = runScript([".stats", ".exit\n"]);
+    expect(cold).toContain("resident: 0");
+  });
+
+  it("reads the leaves ahead of a scan", function () {
+    const rows = 50;
+    const commands = [];
+    const expectedRows = [];
+
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+    runScript(commands);
+
+    // a scan on a cold cache walks the leaf chain and asks for the leaves
+    // it'll want next before it gets to them
+    for (const args of [[], ["--mmap"], ["--io-uring"]]) {
+      const result = runScript(["select", ".stats", ".exit\n"], args);
+      expect(result.slice(0, rows)).toStrictEqual([
+        `lyt-db> ${expectedRows[0]}`,
+        ...expectedRows.slice(1),
+      ]);
+
+      const readAhead = result.find((line) => line.startsWith("read ahead: "));
+      expect(Number(readAhead.split(": ")[1])).toBeGreaterThan(0);
+    }
+  });
+
+  it("switches between sync modes", function () {
+    const result = runScript([
+      ".sync",
+      "insert 1 user1 person1@example.com",
+      ".sync off",
+      "insert 2 user2 person2@example.com",
+      ".sync normal",
+      ".sync",
+      ".sync sometimes",
+      ".exit\n",
+    ]);
+    expect(result).toStrictEqual([
+      "lyt-db> sync: full",
+      "lyt-db> executed.",
+      "lyt-db> lyt-db> executed.",
+      "lyt-db> lyt-db> sync: normal",
+      "lyt-db> sync mode must be off, normal or full.",
+      "lyt-db> ",
+    ]);
+
+    // every mode gets the rows into the db file by the time it's closed
+    const count = runScript(["select count(*)", ".sync", ".exit\n"], ["--sync=off"]);
+    expect(count).toStrictEqual([
+      "lyt-db> ( 2 )",
+      "executed.",
+      "lyt-db> sync: off",
+      "lyt-db> ",
+    ]);
+  });
+
+  it("reads and writes pages thru a memory-mapped db file", function () {
+    const rows = 200;
+    const commands = [];
+    const expectedRows = [];
+
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+    runScript(commands, ["--mmap"]);
+
+    // the file must look the same to the buffer pool
+    const result = runScript(["select", ".exit\n"]);
+    expectedRows[0] = `lyt-db> ${expectedRows[0]}`;
+    expect(result).toStrictEqual([...expectedRows, "executed.", "lyt-db> "]);
+
+    const stats = runScript([".stats", ".exit\n"], ["--mmap"]);
+    expect(stats.slice(0, 2)).toStrictEqual(["lyt-db> pager:", "mode: mmap"]);
+  });
+
+  it("caches pages only in the buffer pool with O_DIRECT", function () {
+    const rows = 200;
+    const commands = [];
+    const expectedRows = [];
+
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+    runScript(commands, ["--direct", "--frames=64"]);
+
+    const result = runScript(["select", ".stats", ".exit\n"], ["--direct"]);
+    expectedRows[0] = `lyt-db> ${expectedRows[0]}`;
+    expect(result.slice(0, rows + 1)).toStrictEqual([...expectedRows, "executed."]);
+    expect(result).toContain("io: sync, direct");
+
+    // the page cache is skipped for the buffer pool, not the memory map
+    expect(runScript([".exit\n"], ["--direct", "--mmap"])[0]).toBe(
+      "--direct and --mmap can't be used together."
+    );
+  });
+
+  it("scans and writes back thru io_uring", function () {
+    const rows = 600;
+    const commands = [];
+    const expectedRows = [];
+
+    for (let i = 1; i != rows + 1; i++) {
+      commands.push(`insert ${i} user${i} person${i}@example.com`);
+      expectedRows.push(`( ${i}, user${i}, person${i}@example.com )`);
+    }
+    commands.push(".exit\n");
+    runScript(commands, ["--io-uring"]);
+
+    // a cold scan thru a small pool has to read leaves in batches.
+    // kernels without io_uring just fall back to plain reads
+    const result = runScript(["select", ".exit\n"], ["--io-uring", "--frames=64"]);
+    expect(result.slice(-(rows + 1), -2)).toStrictEqual(expectedRows.slice(1));
   });
 
   it("allows inserting strings that are the maximum length", function () {
@@ -232,11 +800,12 @@ Turn on debugging with DEBUG=1 like so:
     const commandsExpectedResult = [
       "lyt-db> constants:",
       "ROW_SIZE: 293",
-      "COMMON_NODE_HEADER_SIZE: 6",
-      "LEAF_NODE_HEADER_SIZE: 14",
+      "COMMON_NODE_HEADER_SIZE: 10",
+      "LEAF_NODE_HEADER_SIZE: 22",
       "LEAF_NODE_CELL_SIZE: 297",
-      "LEAF_NODE_SPACE_FOR_CELLS: 4082",
+      "LEAF_NODE_SPACE_FOR_CELLS: 4070",
       "LEAF_NODE_MAX_CELLS: 13",
+      "INTERNAL_NODE_MAX_KEYS: 338",
       "lyt-db> ",
     ];
     const result = runScript(commands);
@@ -415,6 +984,34 @@ Turn on debugging with DEBUG=1 like so:
     expect(result).toStrictEqual(commandsExpectedResult);
   });
 
+  it("keeps rows in order while internal nodes split", function () {
+    const commands = [];
+    const expectedRows = [];
+
+    // a scattered order makes splits happen all over the tree
+    for (let i = 0; i != 1000; i++) {
+      const id = ((i * 7919) % 1000) + 1;
+      commands.push(`insert ${id} user${id} person${id}@example.com`);
+      expectedRows.push(`( ${i + 1}, user${i + 1}, person${i + 1}@example.com )`);
+    }
+    commands.push("select", ".header", ".exit\n");
+
+    let result = runScript(commands, ["--max-keys=2"]);
+    expect(result.slice(1000, 2000)).toStrictEqual([
+      `lyt-db> ${expectedRows[0]}`,
+      ...expectedRows.slice(1),
+    ]);
+
+    // internal nodes that fill a page keep the tree shallow
+    execSync("rm -f test.db test.db-wal test.db-warm");
+    result = runScript(commands);
+    expect(result.slice(1000, 2000)).toStrictEqual([
+      `lyt-db> ${expectedRows[0]}`,
+      ...expectedRows.slice(1),
+    ]);
+    expect(result).toContain("tree height: 2");
+  });
+
   it("allows printing out the structure of a 7-leaf-node btree", function () {
     const commands = [
       "insert 58 user58 person58@example.com",
@@ -569,7 +1166,7 @@ Turn on debugging with DEBUG=1 like so:
       "lyt-db> ",
     ];
 
-    const result = runScript(commands).slice(64);
+    const result = runScript(commands, ["--max-keys=3"]).slice(64);
     expect(result).toStrictEqual(commandsExpectedResult);
   });
 });